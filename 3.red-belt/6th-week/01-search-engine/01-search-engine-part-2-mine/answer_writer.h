@@ -0,0 +1,43 @@
+#pragma once
+
+#include <charconv>
+#include <string>
+#include <string_view>
+
+using namespace std;
+// Formatting answers to string buffer, which is written to stream by one big block later.
+// Numbers are converted by to_chars, without stream, locale and flags of format
+class AnswerWriter {
+public:
+    explicit AnswerWriter(string& buffer) : buffer(buffer) {}
+
+    void WriteText(string_view text) {
+        buffer.append(text);
+    }
+
+    void WriteQuery(string_view query) {
+        buffer.append(query);
+        buffer.push_back(':');
+    }
+    // One found document in format " {docid: 1, hitcount: 2}"
+    void WriteHit(size_t docid, size_t hitcount) {
+        buffer.append(" {docid: ");
+        writeNumber(docid);
+        buffer.append(", hitcount: ");
+        writeNumber(hitcount);
+        buffer.push_back('}');
+    }
+
+    void EndLine() {
+        buffer.push_back('\n');
+    }
+
+private:
+    string& buffer;
+
+    void writeNumber(size_t number) {
+        char digits[20];
+        const auto result = to_chars(begin(digits), end(digits), number);
+        buffer.append(digits, result.ptr - digits);
+    }
+};
@@ -0,0 +1,494 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compact_index.h"
+#include "tokenizer.h"
+
+size_t IndexMemoryReport::TotalBytes() const {
+    return termBytes + postingBytes + overheadBytes;
+}
+
+double IndexMemoryReport::BytesPerPosting() const {
+    return numberOfPostings != 0 ? static_cast<double>(TotalBytes()) / numberOfPostings : 0;
+}
+
+ostream& operator <<(ostream& output, const IndexMemoryReport& report) {
+    return output << "terms: " << report.numberOfTerms << ", "
+                  << "postings: " << report.numberOfPostings << ", "
+                  << "term bytes: " << report.termBytes << ", "
+                  << "posting bytes: " << report.postingBytes << ", "
+                  << "overhead bytes: " << report.overheadBytes << ", "
+                  << "total bytes: " << report.TotalBytes() << ", "
+                  << "bytes per posting: " << fixed << setprecision(2) << report.BytesPerPosting();
+}
+
+IndexMemoryReport MeasurePostingsMap(const PostingsMap& parsedDocuments) {
+    // Strings shorter than this are stored inside of object itself
+    static const size_t smallStringCapacity = string().capacity();
+
+    IndexMemoryReport report;
+    report.numberOfTerms = parsedDocuments.size();
+    // Every node of map stores pointer to the next node and cached hash, and map itself stores buckets
+    report.overheadBytes = parsedDocuments.bucket_count() * sizeof(void*)
+                           + parsedDocuments.size() * (sizeof(void*) + sizeof(size_t));
+
+    for (const auto& [word, documents] : parsedDocuments) {
+        report.numberOfPostings += documents.size();
+        report.termBytes += sizeof(word) + (word.capacity() > smallStringCapacity ? word.capacity() + 1 : 0);
+        report.postingBytes += sizeof(documents) + documents.capacity() * sizeof(documents[0]);
+    }
+
+    return report;
+}
+
+void CompactIndex::Builder::AddDocument(string_view document) {
+    if (numberOfDocuments >= numeric_limits<uint32_t>::max())
+        throw length_error("Too many documents for compact index");
+    // Splitting document to words and finding their ids
+    SplitIntoWordsView(document, documentWords);
+    documentTerms.clear();
+    for (auto word : documentWords)
+        documentTerms.push_back(intern(word));
+    // Equal words became neighbours, so counting them is just counting length of the series
+    sort(begin(documentTerms), end(documentTerms));
+    for (auto it = begin(documentTerms); it != end(documentTerms);) {
+        auto seriesEnd = find_if(it, end(documentTerms), [termId = *it](uint32_t id) { return id != termId; });
+        occurrences.push_back({*it, static_cast<uint32_t>(numberOfDocuments), static_cast<uint32_t>(seriesEnd - it)});
+        it = seriesEnd;
+    }
+
+    numberOfDocuments++;
+}
+
+void CompactIndex::Builder::Append(Builder&& other) {
+    if (numberOfDocuments + other.numberOfDocuments > numeric_limits<uint32_t>::max())
+        throw length_error("Too many documents for compact index");
+    // Words of other builder get new ids in this one
+    vector<uint32_t> newTermIds(other.termOffsets.size() - 1);
+    for (uint32_t termId = 0; termId < newTermIds.size(); termId++)
+        newTermIds[termId] = intern(other.term(termId));
+
+    occurrences.reserve(occurrences.size() + other.occurrences.size());
+    for (const auto& occurrence : other.occurrences)
+        occurrences.push_back({newTermIds[occurrence.termId],
+                               static_cast<uint32_t>(occurrence.docid + numberOfDocuments),
+                               occurrence.hitcount});
+
+    numberOfDocuments += other.numberOfDocuments;
+    other = Builder();
+}
+
+void CompactIndex::Builder::AddPosting(string_view word, size_t docid, uint32_t hitcount) {
+    SetNumberOfDocuments(docid + 1);
+    occurrences.push_back({intern(word), static_cast<uint32_t>(docid), hitcount});
+}
+
+void CompactIndex::Builder::SetNumberOfDocuments(size_t number) {
+    if (number > numeric_limits<uint32_t>::max())
+        throw length_error("Too many documents for compact index");
+    numberOfDocuments = max(numberOfDocuments, number);
+}
+
+vector<CompactIndex::Builder> CompactIndex::Builder::Split(size_t numberOfParts) && {
+    vector<Builder> parts(max<size_t>(1, numberOfParts));
+    // Part of every word and it's id there
+    vector<pair<uint32_t, uint32_t>> newTerms(termOffsets.size() - 1);
+    for (uint32_t termId = 0; termId < newTerms.size(); termId++) {
+        const auto word = term(termId);
+        const auto part = static_cast<uint32_t>(GetPartOfWord(word, parts.size()));
+        newTerms[termId] = {part, parts[part].intern(word)};
+    }
+
+    for (const auto& occurrence : occurrences) {
+        const auto [part, termId] = newTerms[occurrence.termId];
+        parts[part].occurrences.push_back({termId, occurrence.docid, occurrence.hitcount});
+    }
+    for (auto& part : parts)
+        part.numberOfDocuments = numberOfDocuments;
+
+    *this = Builder();
+    return parts;
+}
+
+CompactIndex CompactIndex::Builder::Build() && {
+    vector<Builder> parts;
+    parts.push_back(move(*this));
+    return Build(move(parts));
+}
+// Calling function for every part, in it's own thread, if there are several of them
+template <typename Function>
+void ForEachPart(size_t numberOfParts, Function function) {
+    if (numberOfParts == 1)
+        return function(0);
+
+    vector<future<void>> tasks;
+    for (size_t part = 0; part < numberOfParts; part++)
+        tasks.push_back(async(launch::async, function, part));
+    for (auto& task : tasks)
+        task.get();
+}
+
+CompactIndex CompactIndex::Builder::Build(vector<Builder>&& parts) {
+    size_t numberOfTerms = 0;
+    size_t numberOfOccurrences = 0;
+    size_t arenaSize = 0;
+    CompactIndex index;
+    for (const auto& part : parts) {
+        numberOfTerms += part.termOffsets.size() - 1;
+        numberOfOccurrences += part.occurrences.size();
+        arenaSize += part.arena.size();
+        index.numberOfDocuments = max(index.numberOfDocuments, part.numberOfDocuments);
+    }
+    if (arenaSize >= numeric_limits<uint32_t>::max())
+        throw length_error("Too many words for compact index");
+    if (numberOfOccurrences >= numeric_limits<uint32_t>::max())
+        throw length_error("Too many postings for compact index");
+    // Sorting words of every part to make lookup a binary search
+    vector<vector<uint32_t>> orders(parts.size());
+    ForEachPart(parts.size(), [&parts, &orders](size_t part) {
+        const auto& builder = parts[part];
+        auto& order = orders[part];
+        order.resize(builder.termOffsets.size() - 1);
+        iota(begin(order), end(order), 0);
+        sort(begin(order), end(order), [&builder](uint32_t lhs, uint32_t rhs) {
+            return builder.term(lhs) < builder.term(rhs);
+        });
+    });
+    // Merging sorted words of parts and remembering position of every word in index. Parts have no common words, so
+    // only words, not postings, are merged here
+    vector<vector<uint32_t>> ranks(parts.size());
+    for (size_t part = 0; part < parts.size(); part++)
+        ranks[part].resize(orders[part].size());
+    // Part and position of the next word of it in order
+    using Head = pair<size_t, size_t>;
+    auto isGreater = [&parts, &orders](const Head& lhs, const Head& rhs) {
+        return parts[lhs.first].term(orders[lhs.first][lhs.second])
+               > parts[rhs.first].term(orders[rhs.first][rhs.second]);
+    };
+    priority_queue<Head, vector<Head>, decltype(isGreater)> heads(isGreater);
+    for (size_t part = 0; part < parts.size(); part++)
+        if (!orders[part].empty())
+            heads.push({part, 0});
+    index.ownTermOffsets.reserve(numberOfTerms + 1);
+    index.ownTermOffsets.push_back(0);
+    while (!heads.empty()) {
+        const auto [part, position] = heads.top();
+        heads.pop();
+        const uint32_t termId = orders[part][position];
+        ranks[part][termId] = static_cast<uint32_t>(index.ownTermOffsets.size() - 1);
+        index.ownTermOffsets.push_back(index.ownTermOffsets.back() + parts[part].term(termId).size());
+        if (position + 1 < orders[part].size())
+            heads.push({part, position + 1});
+    }
+    // Counting postings of every word and turning counts to offsets. Every part counts and places postings of it's own
+    // words, so threads never write the same element
+    auto& postingOffsets = index.ownPostingOffsets;
+    postingOffsets.assign(numberOfTerms + 1, 0);
+    ForEachPart(parts.size(), [&parts, &ranks, &postingOffsets](size_t part) {
+        for (const auto& occurrence : parts[part].occurrences)
+            postingOffsets[ranks[part][occurrence.termId] + 1]++;
+    });
+    partial_sum(begin(postingOffsets), end(postingOffsets), begin(postingOffsets));
+    // Writing words and placing postings - occurrences go in order of documents, so postings of every word stay sorted
+    // by id
+    vector<uint32_t> positions(begin(postingOffsets), prev(end(postingOffsets)));
+    index.ownArena.resize(arenaSize);
+    index.ownPostings.resize(numberOfOccurrences);
+    ForEachPart(parts.size(), [&parts, &ranks, &positions, &index](size_t part) {
+        auto& builder = parts[part];
+        const auto& rank = ranks[part];
+        for (uint32_t termId = 0; termId < rank.size(); termId++) {
+            const auto word = builder.term(termId);
+            copy(begin(word), end(word), next(begin(index.ownArena), index.ownTermOffsets[rank[termId]]));
+        }
+        for (const auto& occurrence : builder.occurrences)
+            index.ownPostings[positions[rank[occurrence.termId]]++] = {occurrence.docid, occurrence.hitcount};
+        builder = Builder();
+    });
+
+    index.viewOwnBuffers();
+    return index;
+}
+
+uint32_t CompactIndex::Builder::intern(string_view word) {
+    // Keeping table at most half full, so search of free slot is short
+    if ((termOffsets.size() - 1) * 2 >= slots.size())
+        grow();
+
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = hash<string_view>()(word) & mask;; slot = (slot + 1) & mask) {
+        if (slots[slot] == 0) {
+            if (arena.size() + word.size() >= numeric_limits<uint32_t>::max())
+                throw length_error("Too many words for compact index");
+
+            const auto termId = static_cast<uint32_t>(termOffsets.size() - 1);
+            arena.append(word);
+            termOffsets.push_back(arena.size());
+            slots[slot] = termId + 1;
+            return termId;
+        }
+
+        if (term(slots[slot] - 1) == word)
+            return slots[slot] - 1;
+    }
+}
+
+string_view CompactIndex::Builder::term(uint32_t termId) const {
+    return string_view(arena).substr(termOffsets[termId], termOffsets[termId + 1] - termOffsets[termId]);
+}
+
+void CompactIndex::Builder::grow() {
+    vector<uint32_t> newSlots(slots.size() * 2, 0);
+    const size_t mask = newSlots.size() - 1;
+
+    for (uint32_t termId = 0; termId + 1 < termOffsets.size(); termId++) {
+        size_t slot = hash<string_view>()(term(termId)) & mask;
+        while (newSlots[slot] != 0)
+            slot = (slot + 1) & mask;
+        newSlots[slot] = termId + 1;
+    }
+
+    slots = move(newSlots);
+}
+
+// Memory mapping of whole file, which is unmapped with the last index, using it
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) : path(path) {
+        const int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            throw system_error(errno, generic_category(), "Can't open index file " + path);
+
+        struct stat status = {};
+        if (fstat(descriptor, &status) != 0) {
+            const int error = errno;
+            close(descriptor);
+            throw system_error(error, generic_category(), "Can't read size of index file " + path);
+        }
+
+        size = static_cast<size_t>(status.st_size);
+        if (size != 0)
+            data = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+        // File stays mapped after closing of descriptor
+        const int error = errno;
+        close(descriptor);
+        if (data == MAP_FAILED)
+            throw system_error(error, generic_category(), "Can't map index file " + path);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator =(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data != nullptr && data != MAP_FAILED)
+            munmap(data, size);
+    }
+
+    [[nodiscard]] const char* GetData() const {
+        return static_cast<const char*>(data);
+    }
+
+    [[nodiscard]] size_t GetSize() const {
+        return size;
+    }
+
+    [[nodiscard]] const string& GetPath() const {
+        return path;
+    }
+
+private:
+    string path;
+    void* data = nullptr;
+    size_t size = 0;
+};
+// Beginning of index file. Numbers are written in native byte order, so file is read on machine of the same kind
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numberOfDocuments;
+    uint32_t numberOfTerms;
+    uint32_t numberOfPostings;
+    uint32_t arenaSize;
+    uint32_t reserved;
+};
+
+const char INDEX_FILE_MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+const uint32_t INDEX_FILE_VERSION = 1;
+
+CompactIndex::CompactIndex(istream& document_input) {
+    Builder builder;
+    for (string document; getline(document_input, document);)
+        builder.AddDocument(document);
+    *this = move(builder).Build();
+}
+
+CompactIndex::CompactIndex(CompactIndex&& other) noexcept {
+    *this = move(other);
+}
+
+CompactIndex& CompactIndex::operator =(CompactIndex&& other) noexcept {
+    // Moved vectors keep their buffers, so views stay correct, and moved from index becomes empty
+    ownArena = move(other.ownArena);
+    ownTermOffsets = move(other.ownTermOffsets);
+    ownPostingOffsets = move(other.ownPostingOffsets);
+    ownPostings = move(other.ownPostings);
+    mappedFile = move(other.mappedFile);
+    checkedTerms = move(other.checkedTerms);
+    arena = exchange(other.arena, {});
+    termOffsets = exchange(other.termOffsets, nullptr);
+    postingOffsets = exchange(other.postingOffsets, nullptr);
+    postings = exchange(other.postings, nullptr);
+    numberOfTerms = exchange(other.numberOfTerms, 0);
+    numberOfPostings = exchange(other.numberOfPostings, 0);
+    numberOfDocuments = exchange(other.numberOfDocuments, 0);
+
+    return *this;
+}
+
+void CompactIndex::Save(const string& path) const {
+    ofstream output(path, ios::binary | ios::trunc);
+    if (!output)
+        throw runtime_error("Can't create index file " + path);
+
+    IndexFileHeader header = {};
+    memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.version = INDEX_FILE_VERSION;
+    header.numberOfDocuments = static_cast<uint32_t>(numberOfDocuments);
+    header.numberOfTerms = static_cast<uint32_t>(numberOfTerms);
+    header.numberOfPostings = static_cast<uint32_t>(numberOfPostings);
+    header.arenaSize = static_cast<uint32_t>(arena.size());
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    // Empty index still has first offsets of words and postings
+    static const uint32_t zeroOffset = 0;
+    output.write(reinterpret_cast<const char*>(termOffsets != nullptr ? termOffsets : &zeroOffset),
+                 (numberOfTerms + 1) * sizeof(uint32_t));
+    output.write(reinterpret_cast<const char*>(postingOffsets != nullptr ? postingOffsets : &zeroOffset),
+                 (numberOfTerms + 1) * sizeof(uint32_t));
+    // Words go last, so numbers before them stay aligned
+    output.write(reinterpret_cast<const char*>(postings), numberOfPostings * sizeof(Posting));
+    output.write(arena.data(), arena.size());
+
+    if (!output.flush())
+        throw runtime_error("Can't write index file " + path);
+}
+
+CompactIndex CompactIndex::Open(const string& path) {
+    auto file = make_shared<const MappedFile>(path);
+    const char* data = file->GetData();
+    const size_t size = file->GetSize();
+
+    IndexFileHeader header = {};
+    if (size < sizeof(header))
+        throw runtime_error("Index file " + path + " is too short");
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != INDEX_FILE_VERSION)
+        throw runtime_error("File " + path + " is not an index file of supported version");
+
+    const size_t offsetsSize = (static_cast<size_t>(header.numberOfTerms) + 1) * sizeof(uint32_t);
+    const size_t postingsSize = static_cast<size_t>(header.numberOfPostings) * sizeof(Posting);
+    if (size != sizeof(header) + 2 * offsetsSize + postingsSize + header.arenaSize)
+        throw runtime_error("Index file " + path + " has wrong size");
+
+    CompactIndex index;
+    index.numberOfDocuments = header.numberOfDocuments;
+    index.numberOfTerms = header.numberOfTerms;
+    index.numberOfPostings = header.numberOfPostings;
+    index.termOffsets = reinterpret_cast<const uint32_t*>(data + sizeof(header));
+    index.postingOffsets = reinterpret_cast<const uint32_t*>(data + sizeof(header) + offsetsSize);
+    index.postings = reinterpret_cast<const Posting*>(data + sizeof(header) + 2 * offsetsSize);
+    index.arena = string_view(data + sizeof(header) + 2 * offsetsSize + postingsSize, header.arenaSize);
+    // Checking offsets, so lookup never leaves file. Documents of postings are checked by GetPostings, because reading
+    // of all postings here would read the whole file
+    for (size_t termId = 0; termId < index.numberOfTerms; termId++)
+        if (index.termOffsets[termId] > index.termOffsets[termId + 1]
+            || index.postingOffsets[termId] > index.postingOffsets[termId + 1])
+            throw runtime_error("Index file " + path + " is corrupted");
+    if (index.termOffsets[0] != 0 || index.termOffsets[index.numberOfTerms] != header.arenaSize
+        || index.postingOffsets[0] != 0 || index.postingOffsets[index.numberOfTerms] != header.numberOfPostings)
+        throw runtime_error("Index file " + path + " is corrupted");
+
+    index.mappedFile = move(file);
+    index.checkedTerms = make_unique<atomic<bool>[]>(index.numberOfTerms);
+    return index;
+}
+
+void CompactIndex::checkPostings(size_t termId) const {
+    const Posting* end = postings + postingOffsets[termId + 1];
+    for (const Posting* posting = postings + postingOffsets[termId]; posting != end; posting++)
+        if (posting->docid >= numberOfDocuments)
+            throw runtime_error("Index file " + mappedFile->GetPath() + " is corrupted");
+    checkedTerms[termId].store(true, memory_order_release);
+}
+
+size_t GetPartOfWord(string_view word, size_t numberOfParts) {
+    return (hash<string_view>()(word) >> (numeric_limits<size_t>::digits / 2)) % numberOfParts;
+}
+
+size_t FindTerm(string_view arena, const uint32_t* termOffsets, size_t numberOfTerms, string_view word) {
+    auto term = [arena, termOffsets](size_t termId) {
+        return arena.substr(termOffsets[termId], termOffsets[termId + 1] - termOffsets[termId]);
+    };
+
+    size_t left = 0, right = numberOfTerms;
+    while (left < right) {
+        const size_t middle = left + (right - left) / 2;
+        if (term(middle) < word)
+            left = middle + 1;
+        else
+            right = middle;
+    }
+
+    return left != numberOfTerms && term(left) == word ? left : numberOfTerms;
+}
+
+IteratorRange<const CompactIndex::Posting*> CompactIndex::Lookup(string_view word) const {
+    const size_t termId = FindTermId(word);
+    if (termId == numberOfTerms)
+        return {nullptr, nullptr};
+
+    return GetPostings(termId);
+}
+
+size_t CompactIndex::FindTermId(string_view word) const {
+    return FindTerm(arena, termOffsets, numberOfTerms, word);
+}
+
+IndexMemoryReport CompactIndex::GetMemoryReport() const {
+    IndexMemoryReport report;
+    report.numberOfTerms = numberOfTerms;
+    report.numberOfPostings = numberOfPostings;
+    report.termBytes = arena.size();
+    report.postingBytes = numberOfPostings * sizeof(Posting);
+    report.overheadBytes = numberOfTerms != 0 ? 2 * (numberOfTerms + 1) * sizeof(uint32_t) : 0;
+
+    return report;
+}
+
+void CompactIndex::viewOwnBuffers() {
+    arena = string_view(ownArena.data(), ownArena.size());
+    termOffsets = ownTermOffsets.data();
+    postingOffsets = ownPostingOffsets.data();
+    postings = ownPostings.data();
+    numberOfTerms = ownTermOffsets.size() - 1;
+    numberOfPostings = ownPostings.size();
+}
+
+string_view CompactIndex::term(size_t termId) const {
+    return arena.substr(termOffsets[termId], termOffsets[termId + 1] - termOffsets[termId]);
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "iterator_range.h"
+
+using namespace std;
+// Classic layout of index - every word owns it's own string and vector of (id of document, count of word in it)
+using PostingsMap = unordered_map<string, vector<pair<size_t, uint>>>;
+// Memory, consumed by some index layout, used to compare layouts with each other
+struct IndexMemoryReport {
+    size_t numberOfTerms = 0;
+    size_t numberOfPostings = 0;
+    // Memory, spent on text of words and their headers
+    size_t termBytes = 0;
+    // Memory, spent on postings themselves
+    size_t postingBytes = 0;
+    // Memory, spent on tables, buckets, nodes and so on
+    size_t overheadBytes = 0;
+
+    [[nodiscard]] size_t TotalBytes() const;
+
+    [[nodiscard]] double BytesPerPosting() const;
+};
+
+ostream& operator <<(ostream& output, const IndexMemoryReport& report);
+// Estimating memory of classic layout - it's allocations are spread over heap, so we can only count them
+IndexMemoryReport MeasurePostingsMap(const PostingsMap& parsedDocuments);
+// Binary search of word among sorted words, written one after another. Returns number of words, if word is absent
+size_t FindTerm(string_view arena, const uint32_t* termOffsets, size_t numberOfTerms, string_view word);
+// Part of index, word belongs to, when index is divided between threads by words. High bits of hash are used, because
+// tables of words take low ones
+size_t GetPartOfWord(string_view word, size_t numberOfParts);
+// Region of file, mapped to memory, it's defined together with index
+class MappedFile;
+// Index, which stores all words in one string and all postings in one vector, so it's built without allocation per word
+class CompactIndex {
+public:
+    // Packed posting - id of document and count of word in it
+    struct Posting {
+        uint32_t docid;
+        uint32_t hitcount;
+    };
+    // Collecting documents one by one and then turning them to index
+    class Builder {
+    public:
+        void AddDocument(string_view document);
+        // Appending documents of other builder after documents of this one
+        void Append(Builder&& other);
+        // Dividing builder to builders of the same documents, every word goes to part, chosen by GetPartOfWord
+        vector<Builder> Split(size_t numberOfParts) &&;
+        // Adding posting directly, postings of every word should come in increasing order of ids
+        void AddPosting(string_view word, size_t docid, uint32_t hitcount);
+        // Documents without words count too, so number of documents can be bigger than the last id
+        void SetNumberOfDocuments(size_t number);
+
+        CompactIndex Build() &&;
+        // Building index from builders of the same documents, which have no common words. Every part is sorted and
+        // written to index in it's own thread
+        static CompactIndex Build(vector<Builder>&& parts);
+
+    private:
+        struct Occurrence {
+            uint32_t termId;
+            uint32_t docid;
+            uint32_t hitcount;
+        };
+
+        // Words in order of their first appearance and their offsets in arena
+        string arena;
+        vector<uint32_t> termOffsets = {0};
+        // Open addressing table, storing id of word plus one, zero means empty slot
+        vector<uint32_t> slots = vector<uint32_t>(1024, 0);
+        // Postings in order of documents, sorted by words only at the end
+        vector<Occurrence> occurrences;
+        // Words of current document and their ids, reused between documents
+        vector<string_view> documentWords;
+        vector<uint32_t> documentTerms;
+        size_t numberOfDocuments = 0;
+
+        uint32_t intern(string_view term);
+
+        [[nodiscard]] string_view term(uint32_t termId) const;
+
+        void grow();
+    };
+
+    CompactIndex() = default;
+
+    explicit CompactIndex(istream& document_input);
+
+    CompactIndex(CompactIndex&& other) noexcept;
+
+    CompactIndex& operator =(CompactIndex&& other) noexcept;
+    // Writing index to binary file: header, sorted words with their offsets, offsets of postings and postings
+    void Save(const string& path) const;
+    // Mapping file, written by Save, to memory - queries are answered straight from it's pages
+    static CompactIndex Open(const string& path);
+
+    [[nodiscard]] IteratorRange<const Posting*> Lookup(string_view word) const;
+    // Number of word in sorted order, or number of words, if there is no such word
+    [[nodiscard]] size_t FindTermId(string_view word) const;
+
+    // Postings of mapped file are checked, when they are read first time, so documents of them never leave counters
+    [[nodiscard]] IteratorRange<const Posting*> GetPostings(size_t termId) const {
+        if (checkedTerms != nullptr && !checkedTerms[termId].load(memory_order_acquire))
+            checkPostings(termId);
+        return {postings + postingOffsets[termId], postings + postingOffsets[termId + 1]};
+    }
+
+    [[nodiscard]] size_t GetNumberOfDocuments() const {
+        return numberOfDocuments;
+    }
+
+    [[nodiscard]] size_t GetNumberOfTerms() const {
+        return numberOfTerms;
+    }
+
+    // Calling callback for every word and it's postings, words go in sorted order
+    template <typename Callback>
+    void ForEachTerm(Callback callback) const {
+        for (size_t termId = 0; termId < numberOfTerms; termId++)
+            callback(term(termId), GetPostings(termId));
+    }
+
+    [[nodiscard]] bool IsMapped() const {
+        return mappedFile != nullptr;
+    }
+
+    [[nodiscard]] IndexMemoryReport GetMemoryReport() const;
+
+private:
+    // Buffers of index, built in memory, they are empty if index is mapped from file
+    vector<char> ownArena;
+    vector<uint32_t> ownTermOffsets;
+    vector<uint32_t> ownPostingOffsets;
+    vector<Posting> ownPostings;
+    shared_ptr<const MappedFile> mappedFile;
+    // Words of mapped file, postings of which are already checked
+    unique_ptr<atomic<bool>[]> checkedTerms;
+    // Parts of index, used by lookup. They point either to own buffers or to mapped file
+    // Words, sorted lexicographically, written one after another
+    string_view arena;
+    // Word number i is arena[termOffsets[i], termOffsets[i + 1])
+    const uint32_t* termOffsets = nullptr;
+    // Postings of word number i are postings[postingOffsets[i], postingOffsets[i + 1])
+    const uint32_t* postingOffsets = nullptr;
+    const Posting* postings = nullptr;
+    size_t numberOfTerms = 0;
+    size_t numberOfPostings = 0;
+    size_t numberOfDocuments = 0;
+
+    void viewOwnBuffers();
+
+    void checkPostings(size_t termId) const;
+
+    [[nodiscard]] string_view term(size_t termId) const;
+};
@@ -0,0 +1,49 @@
+#include <limits>
+#include <stdexcept>
+
+#include "compressed_index.h"
+
+CompressedIndex::CompressedIndex(const CompactIndex& compactIndex)
+        : numberOfDocuments(compactIndex.GetNumberOfDocuments()) {
+    termOffsets.reserve(compactIndex.GetNumberOfTerms() + 1);
+    postingOffsets.reserve(compactIndex.GetNumberOfTerms() + 1);
+    // Words already go in sorted order, so they are copied as is, and postings are encoded one by one
+    compactIndex.ForEachTerm([this](string_view word, auto wordPostings) {
+        arena.append(word);
+        termOffsets.push_back(arena.size());
+
+        uint32_t previousDocid = 0;
+        for (const auto& [docid, hitcount] : wordPostings) {
+            const uint64_t delta = docid - previousDocid;
+            writeVarint(delta << 1 | (hitcount > 1 ? 1 : 0));
+            if (hitcount > 1)
+                writeVarint(hitcount - 2);
+            previousDocid = docid;
+        }
+        numberOfPostings += wordPostings.size();
+
+        if (postings.size() > numeric_limits<uint32_t>::max())
+            throw length_error("Too many postings for compressed index");
+        postingOffsets.push_back(postings.size());
+    });
+    postings.shrink_to_fit();
+}
+
+IndexMemoryReport CompressedIndex::GetMemoryReport() const {
+    IndexMemoryReport report;
+    report.numberOfTerms = GetNumberOfTerms();
+    report.numberOfPostings = numberOfPostings;
+    report.termBytes = arena.size();
+    report.postingBytes = postings.size();
+    report.overheadBytes = GetNumberOfTerms() != 0 ? 2 * (GetNumberOfTerms() + 1) * sizeof(uint32_t) : 0;
+
+    return report;
+}
+
+void CompressedIndex::writeVarint(uint64_t value) {
+    while (value >= 0x80) {
+        postings.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    postings.push_back(static_cast<uint8_t>(value));
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compact_index.h"
+
+using namespace std;
+// Index with the same sorted words, as compact one, but with postings, packed to bytes. Every posting is a varint of
+// difference of it's id with previous id, shifted by one bit, which is set if count of word is bigger than one.
+// Only then the count itself follows, as one more varint. So posting of rare word usually takes one or two bytes
+class CompressedIndex {
+public:
+    CompressedIndex() = default;
+
+    explicit CompressedIndex(const CompactIndex& compactIndex);
+
+    [[nodiscard]] size_t GetNumberOfDocuments() const {
+        return numberOfDocuments;
+    }
+
+    [[nodiscard]] size_t GetNumberOfTerms() const {
+        return termOffsets.size() - 1;
+    }
+
+    // Calling callback(docid, hitcount) for every posting of word, postings are decoded on the fly
+    template <typename Callback>
+    void ForEachPosting(string_view word, Callback callback) const {
+        const size_t termId = FindTerm(arena, termOffsets.data(), GetNumberOfTerms(), word);
+        if (termId != GetNumberOfTerms())
+            decode(termId, callback);
+    }
+
+    // Calling callback(word, docid, hitcount) for every posting of every word, words go in sorted order
+    template <typename Callback>
+    void ForEachTermPosting(Callback callback) const {
+        for (size_t termId = 0; termId < GetNumberOfTerms(); termId++) {
+            const auto word = term(termId);
+            decode(termId, [&callback, word](uint32_t docid, uint32_t hitcount) {
+                callback(word, docid, hitcount);
+            });
+        }
+    }
+
+    [[nodiscard]] IndexMemoryReport GetMemoryReport() const;
+
+private:
+    // Words, sorted lexicographically, and their offsets, like in compact index
+    string arena;
+    vector<uint32_t> termOffsets = {0};
+    // Encoded postings of word number i are postings[postingOffsets[i], postingOffsets[i + 1])
+    vector<uint32_t> postingOffsets = {0};
+    vector<uint8_t> postings;
+    size_t numberOfPostings = 0;
+    size_t numberOfDocuments = 0;
+
+    // Seven bits of number in every byte, starting from the lowest ones, the highest bit is set if more bytes follow
+    static uint64_t readVarint(const uint8_t*& position) {
+        // Most of numbers are small, so they are read without loop
+        if (*position < 0x80)
+            return *position++;
+
+        uint64_t value = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            const uint8_t byte = *position++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+    }
+
+    void writeVarint(uint64_t value);
+
+    template <typename Callback>
+    void decode(size_t termId, Callback&& callback) const {
+        const uint8_t* position = postings.data() + postingOffsets[termId];
+        const uint8_t* const end = postings.data() + postingOffsets[termId + 1];
+        uint32_t docid = 0;
+        while (position != end) {
+            const uint64_t value = readVarint(position);
+            docid += static_cast<uint32_t>(value >> 1);
+            const auto hitcount = (value & 1) != 0 ? static_cast<uint32_t>(readVarint(position)) + 2 : 1;
+            callback(docid, hitcount);
+        }
+    }
+
+    [[nodiscard]] string_view term(size_t termId) const {
+        return string_view(arena).substr(termOffsets[termId], termOffsets[termId + 1] - termOffsets[termId]);
+    }
+};
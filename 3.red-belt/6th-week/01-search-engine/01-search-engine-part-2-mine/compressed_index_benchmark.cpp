@@ -0,0 +1,69 @@
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "profile_advanced.h"
+#include "search_server.h"
+
+using namespace std;
+// Benchmark of compressed postings against compact ones, built with sources of server, without tests and other tools:
+// g++ -O2 -pthread compressed_index_benchmark.cpp $(ls *.cpp | grep -v '_test\|_benchmark')
+// Words are chosen with probability, falling with their number, so there are both long and short lists of postings
+string GenerateLines(size_t seed, size_t numberOfLines, size_t vocabularySize, size_t wordsPerLine) {
+    mt19937 generator(seed);
+    uniform_real_distribution<double> power(0, 1);
+    ostringstream output;
+
+    for (size_t line = 0; line < numberOfLines; line++) {
+        for (size_t word = 0; word < wordsPerLine; word++) {
+            const auto wordNumber = static_cast<size_t>(pow(static_cast<double>(vocabularySize), power(generator)));
+            output << (word != 0 ? " " : "") << 'w' << wordNumber - 1;
+        }
+        output << '\n';
+    }
+
+    return output.str();
+}
+
+int main() {
+    const size_t numberOfDocuments = 20'000;
+    const size_t numberOfQueries = 2'000;
+    const size_t numberOfRounds = 3;
+    const string documents = GenerateLines(1, numberOfDocuments, 20'000, 100);
+    const string queries = GenerateLines(2, numberOfQueries, 20'000, 5);
+
+    size_t compactBytes = 0;
+    for (const auto indexMode : {IndexMode::Compact, IndexMode::Compressed}) {
+        const string name = indexMode == IndexMode::Compact ? "Compact" : "Compressed";
+        SearchServer::Settings settings;
+        settings.indexMode = indexMode;
+        settings.queryThreads = 1;
+        // Rounds repeat the same queries, so cached answers would hide the time of reading postings
+        settings.cacheCapacity = 0;
+
+        istringstream documentInput(documents);
+        SearchServer server(documentInput, settings);
+        const auto report = server.GetMemoryReport();
+        cerr << name << " index: " << report << endl;
+        if (indexMode == IndexMode::Compact)
+            compactBytes = report.TotalBytes();
+        else
+            cerr << "  Memory saved: " << compactBytes - report.TotalBytes() << " bytes" << endl;
+        // Time of queries is printed by TotalDuration, when it's destroyed, so throughput is printed before it
+        TotalDuration answering("  " + name + " queries, " + to_string(numberOfRounds) + " rounds of "
+                                + to_string(numberOfQueries));
+        for (size_t round = 0; round < numberOfRounds; round++) {
+            istringstream queryInput(queries);
+            ostringstream output;
+            ADD_DURATION(answering)
+            server.AddQueriesStream(queryInput, output);
+        }
+        const duration<double> elapsed = answering.value;
+        cerr << "  Throughput: " << static_cast<size_t>(numberOfRounds * numberOfQueries / elapsed.count())
+             << " queries/s" << endl;
+    }
+
+    return 0;
+}
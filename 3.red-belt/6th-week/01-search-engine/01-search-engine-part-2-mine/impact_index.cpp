@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <utility>
+
+#include "impact_index.h"
+
+ImpactIndex::ImpactIndex(CompactIndex compactIndex) : docidOrdered(move(compactIndex)) {
+    impactOffsets.reserve(docidOrdered.GetNumberOfTerms() + 1);
+    docidOrdered.ForEachTerm([this](string_view, auto postings) {
+        const size_t first = impactPostings.size();
+        impactPostings.insert(end(impactPostings), begin(postings), end(postings));
+        // Postings are already sorted by ids, so stable sort keeps smaller ids first among equal counts
+        stable_sort(next(begin(impactPostings), first), end(impactPostings),
+                    [](const Posting& lhs, const Posting& rhs) {
+                        return lhs.hitcount > rhs.hitcount;
+                    });
+        impactOffsets.push_back(impactPostings.size());
+    });
+}
+
+ImpactIndex::TermPostings ImpactIndex::Lookup(string_view word) const {
+    const size_t termId = docidOrdered.FindTermId(word);
+    if (termId == docidOrdered.GetNumberOfTerms())
+        return {{nullptr, nullptr}, {nullptr, nullptr}};
+
+    return {docidOrdered.GetPostings(termId),
+            {impactPostings.data() + impactOffsets[termId], impactPostings.data() + impactOffsets[termId + 1]}};
+}
+
+IndexMemoryReport ImpactIndex::GetMemoryReport() const {
+    auto report = docidOrdered.GetMemoryReport();
+    report.postingBytes += impactPostings.size() * sizeof(Posting);
+    report.overheadBytes += impactOffsets.size() > 1 ? impactOffsets.size() * sizeof(uint32_t) : 0;
+
+    return report;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "compact_index.h"
+#include "iterator_range.h"
+
+using namespace std;
+// Compact index, where postings of every word are also stored in order of decreasing count of word and increasing
+// ids for equal counts. So the first posting of word in this order has the biggest count of it in any document,
+// and best documents for one word are just the first ones
+class ImpactIndex {
+public:
+    using Posting = CompactIndex::Posting;
+    // Postings of one word in both orders
+    struct TermPostings {
+        IteratorRange<const Posting*> byDocid;
+        IteratorRange<const Posting*> byImpact;
+    };
+
+    ImpactIndex() = default;
+
+    explicit ImpactIndex(CompactIndex compactIndex);
+
+    [[nodiscard]] TermPostings Lookup(string_view word) const;
+
+    [[nodiscard]] const CompactIndex& GetDocidOrdered() const {
+        return docidOrdered;
+    }
+
+    [[nodiscard]] size_t GetNumberOfDocuments() const {
+        return docidOrdered.GetNumberOfDocuments();
+    }
+
+    [[nodiscard]] IndexMemoryReport GetMemoryReport() const;
+
+private:
+    CompactIndex docidOrdered;
+    // Postings of word number i in order of impact are impactPostings[impactOffsets[i], impactOffsets[i + 1])
+    vector<uint32_t> impactOffsets = {0};
+    vector<Posting> impactPostings;
+};
@@ -0,0 +1,38 @@
+#include <algorithm>
+
+#include "query_cache.h"
+
+QueryCache::QueryCache(size_t capacity)
+        : shardCapacity(max<size_t>(1, (capacity + NUMBER_OF_SHARDS - 1) / NUMBER_OF_SHARDS)) {}
+
+bool QueryCache::Find(const string& key, string& answer) {
+    auto& shard = getShard(key);
+    lock_guard guard(shard.m);
+
+    auto position = shard.positions.find(key);
+    if (position == end(shard.positions))
+        return false;
+    // Used answer moves to the beginning, so it's thrown away last
+    shard.entries.splice(begin(shard.entries), shard.entries, position->second);
+    answer = position->second->second;
+    return true;
+}
+
+void QueryCache::Insert(const string& key, const string& answer) {
+    auto& shard = getShard(key);
+    lock_guard guard(shard.m);
+    // Other thread could answer the same query meanwhile
+    if (shard.positions.count(key) != 0)
+        return;
+
+    if (shard.entries.size() >= shardCapacity) {
+        shard.positions.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+    }
+    shard.entries.emplace_front(key, answer);
+    shard.positions.emplace(shard.entries.front().first, begin(shard.entries));
+}
+
+QueryCache::Shard& QueryCache::getShard(const string& key) {
+    return shards[hash<string>()(key) % NUMBER_OF_SHARDS];
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+// Answers of queries for one version of index. Key of query is it's sorted words, so order of words doesn't matter.
+// Cache is split to shards with their own locks and least recently used answers are thrown away from every shard
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity);
+    // Copying cached answer, returns false if there is no answer for this key
+    bool Find(const string& key, string& answer);
+
+    void Insert(const string& key, const string& answer);
+
+private:
+    static const size_t NUMBER_OF_SHARDS = 16;
+
+    struct Shard {
+        mutex m;
+        // Pairs of key and answer, the most recently used go first
+        list<pair<string, string>> entries;
+        // Keys point to strings in list, nodes of list never move
+        unordered_map<string_view, list<pair<string, string>>::iterator> positions;
+    };
+
+    size_t shardCapacity;
+    array<Shard, NUMBER_OF_SHARDS> shards;
+
+    Shard& getShard(const string& key);
+};
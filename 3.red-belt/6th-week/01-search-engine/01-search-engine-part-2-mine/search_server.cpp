@@ -1,89 +1,815 @@
-#include <sstream>
-#include <iterator>
+#include <stdexcept>
 #include <algorithm>
-#include <numeric>
-#include <mutex>
+#include <deque>
+#include <thread>
+#include <type_traits>
 
 #include "search_server.h"
+#include "answer_writer.h"
 #include "iterator_range.h"
+#include "stage_profiler.h"
+#include "tokenizer.h"
 
 vector<string> SplitIntoWords(const string& line) {
-    istringstream words_input(line);
-    return {make_move_iterator(istream_iterator<string>(words_input)),
-            make_move_iterator(istream_iterator<string>())};
+    const auto words = SplitIntoWordsView(line);
+    return {begin(words), end(words)};
 }
 
-SearchServer::SearchServer(istream& document_input) {
+// Counting word in document, ids of documents should come in increasing order
+void AddWord(PostingsMap& parsedDocuments, const string& word, size_t id) {
+    auto& documents = parsedDocuments[word];
+    // Checking if it's already added and increment it or add it if not
+    if (!documents.empty() && documents.back().first == id)
+        documents.back().second++;
+    else
+        documents.emplace_back(id, 1);
+}
+
+// Adding words of document to index, ids of documents should come in increasing order
+void AddDocument(PostingsMap& parsedDocuments, const string& document, size_t id) {
+    // Buffers are reused by all documents of thread, so only new words are copied to map
+    thread_local vector<string_view> words;
+    thread_local string key;
+    SplitIntoWordsView(document, words);
+    // For every word
+    for (auto word : words) {
+        key.assign(word);
+        AddWord(parsedDocuments, key, id);
+    }
+}
+// Adding words of document to parts of index, every word goes to part, chosen by GetPartOfWord
+void AddDocument(vector<PostingsMap>& parts, string_view document, size_t id) {
+    thread_local vector<string_view> words;
+    thread_local string key;
+    SplitIntoWordsView(document, words);
+    for (auto word : words) {
+        key.assign(word);
+        AddWord(parts[GetPartOfWord(key, parts.size())], key, id);
+    }
+}
+// Input is read by blocks, extended to the end of line, and every block is indexed by worker. Every thread gets one
+// block, if size of input is known, and blocks aren't smaller than this anyway
+const size_t MIN_CHUNK_SIZE = 1 << 20;
+// Size of block, if stream can't tell it's size
+const size_t DEFAULT_CHUNK_SIZE = 4 << 20;
+
+size_t ChooseChunkSize(istream& document_input, size_t numberOfThreads) {
+    const auto position = document_input.tellg();
+    if (position == -1 || !document_input.seekg(0, ios::end)) {
+        document_input.clear();
+        return DEFAULT_CHUNK_SIZE;
+    }
+    const auto size = static_cast<size_t>(document_input.tellg() - position);
+    document_input.seekg(position);
+
+    return max(MIN_CHUNK_SIZE, size / numberOfThreads + 1);
+}
+// Reading input straight to chunks, without splitting it to documents, and building partial index of every chunk in
+// it's own thread, at most numberOfThreads of them at once. Partial indexes are returned in order of chunks
+template <typename Chunk, typename BuildChunk>
+vector<Chunk> BuildChunks(istream& document_input, size_t numberOfThreads, size_t& numberOfDocuments,
+                          BuildChunk buildChunk) {
+    const size_t chunkSize = ChooseChunkSize(document_input, numberOfThreads);
+    vector<Chunk> chunks;
+    deque<future<Chunk>> chunkFutures;
+    numberOfDocuments = 0;
+    while (true) {
+        string text(chunkSize, '\0');
+        document_input.read(text.data(), chunkSize);
+        text.resize(document_input.gcount());
+        if (text.empty())
+            break;
+        // Every document of chunk ends with line break, including the last one of input
+        if (text.back() != '\n') {
+            string rest;
+            getline(document_input, rest);
+            text += rest;
+            text += '\n';
+        }
+
+        if (chunkFutures.size() >= numberOfThreads) {
+            chunks.push_back(chunkFutures.front().get());
+            chunkFutures.pop_front();
+        }
+        const size_t firstId = numberOfDocuments;
+        numberOfDocuments += count(begin(text), end(text), '\n');
+        chunkFutures.push_back(async(launch::async, [&buildChunk, text = move(text), firstId] {
+            vector<string_view> documents;
+            for (size_t first = 0, last = 0; first < text.size(); first = last + 1) {
+                last = text.find('\n', first);
+                documents.push_back(string_view(text).substr(first, last - first));
+            }
+            return buildChunk(documents, firstId);
+        }));
+    }
+
+    for (auto& chunkFuture : chunkFutures)
+        chunks.push_back(chunkFuture.get());
+
+    return chunks;
+}
+// Merging parts of chunks, every part of words is merged in it's own thread. Chunks are taken in order, so postings of
+// every word stay sorted by id of document
+PostingsMap MergeChunks(vector<vector<PostingsMap>>&& chunks, size_t numberOfParts) {
+    if (chunks.empty())
+        return {};
+
+    vector<future<PostingsMap>> partFutures;
+    for (size_t part = 0; part < numberOfParts; part++)
+        partFutures.push_back(async(launch::async, [&chunks, part] {
+            PostingsMap result = move(chunks.front()[part]);
+            for (auto& chunk : IteratorRange(next(begin(chunks)), end(chunks))) {
+                for (auto& [word, documents] : chunk[part]) {
+                    auto& resultDocuments = result[word];
+                    if (resultDocuments.empty())
+                        resultDocuments = move(documents);
+                    else
+                        resultDocuments.insert(end(resultDocuments), begin(documents), end(documents));
+                }
+                // Part of chunk is freed by the same thread
+                chunk[part] = PostingsMap();
+            }
+            return result;
+        }));
+
+    vector<PostingsMap> parts;
+    size_t numberOfWords = 0;
+    for (auto& partFuture : partFutures) {
+        parts.push_back(partFuture.get());
+        numberOfWords += parts.back().size();
+    }
+    // Parts have no common words, so their nodes are moved to one map without copying of words and postings
+    PostingsMap result;
+    result.reserve(numberOfWords);
+    for (auto& part : parts)
+        result.merge(part);
+
+    return result;
+}
+
+size_t ResolveNumberOfThreads(size_t numberOfThreads) {
+    return numberOfThreads != 0 ? numberOfThreads : max(1u, thread::hardware_concurrency());
+}
+
+// Compact index is built by it's own builder, without map. Every chunk is divided by words, so every part of index is
+// merged from chunks and written in it's own thread
+CompactIndex BuildCompactIndex(istream& document_input, size_t numberOfThreads) {
+    if (numberOfThreads == 1)
+        return CompactIndex(document_input);
+
+    size_t numberOfDocuments = 0;
+    auto chunks = BuildChunks<vector<CompactIndex::Builder>>(
+            document_input, numberOfThreads, numberOfDocuments,
+            [numberOfThreads](const vector<string_view>& documents, size_t) {
+                CompactIndex::Builder builder;
+                for (const auto& document : documents)
+                    builder.AddDocument(document);
+                return move(builder).Split(numberOfThreads);
+            });
+    if (chunks.empty())
+        return CompactIndex::Builder().Build();
+
+    vector<future<CompactIndex::Builder>> partFutures;
+    for (size_t part = 0; part < numberOfThreads; part++)
+        partFutures.push_back(async(launch::async, [&chunks, part] {
+            CompactIndex::Builder builder = move(chunks.front()[part]);
+            for (auto& chunk : IteratorRange(next(begin(chunks)), end(chunks)))
+                builder.Append(move(chunk[part]));
+            return builder;
+        }));
+
+    vector<CompactIndex::Builder> parts;
+    for (auto& partFuture : partFutures)
+        parts.push_back(partFuture.get());
+
+    return CompactIndex::Builder::Build(move(parts));
+}
+
+SearchServer::SearchServer(const Settings& settings)
+        : settings(settings)
+        , queryPool(ResolveNumberOfThreads(settings.queryThreads), settings.queueCapacity) {}
+
+SearchServer::SearchServer(istream& document_input) : SearchServer(Settings()) {
+    UpdateDocumentBase(document_input);
+}
+
+SearchServer::SearchServer(istream& document_input, const Settings& settings) : SearchServer(settings) {
     UpdateDocumentBase(document_input);
 }
 
 void SearchServer::UpdateDocumentBase(istream& document_input) {
-    // Creating new dataset from given input
-    unordered_map<string, vector<pair<size_t, uint>>> newParsedDocuments;
-    size_t newNumberOfDocuments = 0;
-    // For every document
-    for (string document; getline(document_input, document); newNumberOfDocuments++) {
-        // For every word
-        for (auto& word : SplitIntoWords(document)) {
-            auto& documents = newParsedDocuments[move(word)];
-            // Checking if it's already added and increment it or add it if not
-            if (!documents.empty() && documents.back().first == newNumberOfDocuments)
-                documents.back().second++;
-            else
-                documents.emplace_back(newNumberOfDocuments, 1);
-        }
-    }
-    // Locking access to main dataset and swapping it with newly created new one
-    mutex m;
-    lock_guard guard(m);
-    swap(parsedDocuments, newParsedDocuments);
-    swap(numberOfDocuments, newNumberOfDocuments);
-}
-// Main "search" function - single-thread solution
-void AddQueriesStreamSingleThread(istream& query_input, ostream& search_results_output,
-                                  unordered_map<string, vector<pair<size_t, uint>>>& parsedDocuments,
-                                  size_t numberOfDocuments) {
-    // For every query
-    for (string query; getline(query_input, query);) {
-        // Storing number of words, located both in document and query
-        vector<uint> summedUpCount(numberOfDocuments, 0);
-        // Storing indexes of previous sums
-        vector<size_t> idOfSummedUp(numberOfDocuments);
-        iota(begin(idOfSummedUp), end(idOfSummedUp), 0);
-        auto words = SplitIntoWords(query);
-        // For every word
-        for (auto& word : words) {
-            // Locking access to dataset for this loop
-            mutex m;
-            lock_guard guard(m);
-            // Adding number of word entry in documents to a related variables in vector
-            auto position = parsedDocuments.find(word);
-            for (auto&[id, count] :
-                    (position != end(parsedDocuments) ?
-                     position->second : vector<pair<size_t, uint>>()))
-                summedUpCount[id] += count;
-        }
-        // Then partially sort them, to find five with biggest number (of words both in query and document)
-        partial_sort(begin(idOfSummedUp), end(Head(idOfSummedUp, 5)), end(idOfSummedUp),
-                     [&summedUpCount](int64_t lhs, int64_t rhs) {
-                         return pair(summedUpCount[lhs], -lhs) > pair(summedUpCount[rhs], -rhs);
-                     });
-        // Formatting result to a output stream including that five biggest numbers and id of related documents
-        search_results_output << query << ':';
-        for (size_t id : Head(idOfSummedUp, 5)) {
-            const uint count = summedUpCount[id];
-
-            if (count == 0) {
+    PROFILE_STAGE(Stage::Build)
+    const size_t numberOfThreads = ResolveNumberOfThreads(settings.buildThreads);
+    // Creating new version of index from given input
+    auto newSnapshot = make_shared<IndexSnapshot>();
+    BaseIndex newIndex;
+    if (settings.indexMode == IndexMode::Compact) {
+        auto newCompactIndex = BuildCompactIndex(document_input, numberOfThreads);
+        newSnapshot->numberOfDocuments = newCompactIndex.GetNumberOfDocuments();
+        newIndex = move(newCompactIndex);
+    } else if (settings.indexMode == IndexMode::Compressed) {
+        // Compressed index is encoded from compact one, which is freed right after
+        CompressedIndex newCompressedIndex(BuildCompactIndex(document_input, numberOfThreads));
+        newSnapshot->numberOfDocuments = newCompressedIndex.GetNumberOfDocuments();
+        newIndex = move(newCompressedIndex);
+    } else if (settings.indexMode == IndexMode::Impact) {
+        ImpactIndex newImpactIndex(BuildCompactIndex(document_input, numberOfThreads));
+        newSnapshot->numberOfDocuments = newImpactIndex.GetNumberOfDocuments();
+        newIndex = move(newImpactIndex);
+    } else {
+        PostingsMap newParsedDocuments;
+        size_t newNumberOfDocuments = 0;
+        if (numberOfThreads == 1) {
+            // For every document
+            for (string document; getline(document_input, document); newNumberOfDocuments++)
+                AddDocument(newParsedDocuments, document, newNumberOfDocuments);
+        } else {
+            auto chunks = BuildChunks<vector<PostingsMap>>(
+                    document_input, numberOfThreads, newNumberOfDocuments,
+                    [numberOfThreads](const vector<string_view>& documents, size_t firstId) {
+                        vector<PostingsMap> parts(numberOfThreads);
+                        for (const auto& document : documents)
+                            AddDocument(parts, document, firstId++);
+                        return parts;
+                    });
+            newParsedDocuments = MergeChunks(move(chunks), numberOfThreads);
+        }
+
+        newSnapshot->numberOfDocuments = newNumberOfDocuments;
+        newIndex = move(newParsedDocuments);
+    }
+    newSnapshot->index = make_shared<const BaseIndex>(move(newIndex));
+    // New base replaces all appended and removed documents
+    lock_guard guard(updateMutex);
+    newSnapshot->generation = GetSnapshot()->generation + 1;
+    publish(move(newSnapshot));
+}
+
+void SearchServer::AddDocuments(istream& document_input) {
+    lock_guard guard(updateMutex);
+    const auto currentSnapshot = GetSnapshot();
+    // New documents become segment with ids after all existing documents
+    auto segment = make_shared<PostingsMap>();
+    size_t id = currentSnapshot->numberOfDocuments;
+    for (string document; getline(document_input, document); id++)
+        AddDocument(*segment, document, id);
+    if (id == currentSnapshot->numberOfDocuments)
+        return;
+
+    auto newSnapshot = make_shared<IndexSnapshot>(*currentSnapshot);
+    newSnapshot->segments.push_back(move(segment));
+    newSnapshot->numberOfDocuments = id;
+    publish(newSnapshot);
+    scheduleMerge(*newSnapshot);
+}
+
+void SearchServer::RemoveDocument(size_t docid) {
+    lock_guard guard(updateMutex);
+    const auto currentSnapshot = GetSnapshot();
+    if (docid >= currentSnapshot->numberOfDocuments)
+        throw out_of_range("There is no document with id " + to_string(docid));
+    if (find(begin(currentSnapshot->tombstones), end(currentSnapshot->tombstones), docid)
+        != end(currentSnapshot->tombstones))
+        return;
+
+    auto newSnapshot = make_shared<IndexSnapshot>(*currentSnapshot);
+    newSnapshot->tombstones.push_back(docid);
+    publish(newSnapshot);
+    scheduleMerge(*newSnapshot);
+}
+// Building base of the same layout, which contains base and segments of snapshot without removed documents
+PostingsMap MergeIntoBase(const PostingsMap& parsedDocuments, const IndexSnapshot& source,
+                          const vector<bool>& removed) {
+    PostingsMap result;
+    // Base goes first and segments follow in order of their ids, so postings of every word stay sorted
+    auto append = [&result, &removed](const string& word, const vector<pair<size_t, uint>>& documents) {
+        vector<pair<size_t, uint>>* resultDocuments = nullptr;
+        for (const auto& [id, count] : documents)
+            if (!removed[id]) {
+                if (resultDocuments == nullptr)
+                    resultDocuments = &result[word];
+                resultDocuments->emplace_back(id, count);
+            }
+    };
+
+    for (const auto& [word, documents] : parsedDocuments)
+        append(word, documents);
+    for (const auto& segment : source.segments)
+        for (const auto& [word, documents] : *segment)
+            append(word, documents);
+
+    return result;
+}
+
+CompactIndex MergeIntoBase(const CompactIndex& compactIndex, const IndexSnapshot& source,
+                           const vector<bool>& removed) {
+    CompactIndex::Builder builder;
+    compactIndex.ForEachTerm([&builder, &removed](string_view word, auto postings) {
+        for (const auto& [id, count] : postings)
+            if (!removed[id])
+                builder.AddPosting(word, id, count);
+    });
+    for (const auto& segment : source.segments)
+        for (const auto& [word, documents] : *segment)
+            for (const auto& [id, count] : documents)
+                if (!removed[id])
+                    builder.AddPosting(word, id, count);
+    builder.SetNumberOfDocuments(source.numberOfDocuments);
+
+    return move(builder).Build();
+}
+
+CompressedIndex MergeIntoBase(const CompressedIndex& compressedIndex, const IndexSnapshot& source,
+                              const vector<bool>& removed) {
+    CompactIndex::Builder builder;
+    compressedIndex.ForEachTermPosting([&builder, &removed](string_view word, uint32_t id, uint32_t count) {
+        if (!removed[id])
+            builder.AddPosting(word, id, count);
+    });
+    for (const auto& segment : source.segments)
+        for (const auto& [word, documents] : *segment)
+            for (const auto& [id, count] : documents)
+                if (!removed[id])
+                    builder.AddPosting(word, id, count);
+    builder.SetNumberOfDocuments(source.numberOfDocuments);
+
+    return CompressedIndex(move(builder).Build());
+}
+
+ImpactIndex MergeIntoBase(const ImpactIndex& impactIndex, const IndexSnapshot& source, const vector<bool>& removed) {
+    return ImpactIndex(MergeIntoBase(impactIndex.GetDocidOrdered(), source, removed));
+}
+
+BaseIndex MergeChanges(const IndexSnapshot& source) {
+    PROFILE_STAGE(Stage::Merge)
+    vector<bool> removed(source.numberOfDocuments, false);
+    for (size_t id : source.tombstones)
+        removed[id] = true;
+
+    return visit([&source, &removed](const auto& index) -> BaseIndex {
+        return MergeIntoBase(index, source, removed);
+    }, *source.index);
+}
+
+bool NeedsMerge(const IndexSnapshot& currentSnapshot, const SearchServer::Settings& settings) {
+    return currentSnapshot.segments.size() > settings.maxSegments
+           || currentSnapshot.tombstones.size() > settings.maxTombstones;
+}
+
+void SearchServer::publish(shared_ptr<IndexSnapshot> newSnapshot, bool keepCache) {
+    // Answers of old version can't be used with new one, so they are invalidated together with it
+    if (!keepCache)
+        newSnapshot->cache = settings.cacheCapacity != 0 ? make_shared<QueryCache>(settings.cacheCapacity) : nullptr;
+    // Queries, which already hold old version, finish with it, and it's freed after them
+    atomic_store(&snapshot, shared_ptr<const IndexSnapshot>(move(newSnapshot)));
+}
+
+void SearchServer::scheduleMerge(const IndexSnapshot& currentSnapshot) {
+    // Only one merge runs at once, changes, made while it works, are merged by it in the next round
+    if (!NeedsMerge(currentSnapshot, settings) || merging)
+        return;
+    // Previous merge is finished, so here we only get it's error, if there was one
+    if (mergeTask.valid())
+        mergeTask.get();
+
+    merging = true;
+    mergeTask = async(launch::async, &SearchServer::mergeInBackground, this);
+}
+
+void SearchServer::mergeInBackground() {
+    try {
+        while (true) {
+            const auto source = GetSnapshot();
+            const auto mergedIndex = make_shared<const BaseIndex>(MergeChanges(*source));
+
+            lock_guard guard(updateMutex);
+            const auto currentSnapshot = GetSnapshot();
+            // Base could be rebuilt meanwhile, then merged one is already useless
+            if (currentSnapshot->generation != source->generation) {
+                merging = false;
+                return;
+            }
+            // Changes only were added after source, so it's changes are the first ones. Answers stay the same
+            auto newSnapshot = make_shared<IndexSnapshot>(*currentSnapshot);
+            newSnapshot->index = mergedIndex;
+            newSnapshot->segments.erase(begin(newSnapshot->segments),
+                                        next(begin(newSnapshot->segments), source->segments.size()));
+            newSnapshot->tombstones.erase(begin(newSnapshot->tombstones),
+                                          next(begin(newSnapshot->tombstones), source->tombstones.size()));
+            publish(newSnapshot, true);
+
+            if (!NeedsMerge(*newSnapshot, settings)) {
+                merging = false;
+                return;
+            }
+        }
+    } catch (...) {
+        lock_guard guard(updateMutex);
+        merging = false;
+        throw;
+    }
+}
+// Calling callback(id, count) for every posting of word in any layout of index
+template <typename Callback>
+void ForEachPosting(const PostingsMap& parsedDocuments, string_view word, Callback callback) {
+    // Map can be searched only by string, so word is copied to buffer, reused by all queries of thread
+    thread_local string key;
+    key.assign(word);
+    auto position = parsedDocuments.find(key);
+    if (position != end(parsedDocuments))
+        for (const auto& [id, count] : position->second)
+            callback(id, count);
+}
+
+template <typename Callback>
+void ForEachPosting(const CompactIndex& compactIndex, string_view word, Callback callback) {
+    for (const auto& [id, count] : compactIndex.Lookup(word))
+        callback(id, count);
+}
+
+template <typename Callback>
+void ForEachPosting(const CompressedIndex& compressedIndex, string_view word, Callback callback) {
+    compressedIndex.ForEachPosting(word, callback);
+}
+
+template <typename Callback>
+void ForEachPosting(const ImpactIndex& impactIndex, string_view word, Callback callback) {
+    ForEachPosting(impactIndex.GetDocidOrdered(), word, callback);
+}
+const size_t MAX_NUMBER_OF_RESULTS = 5;
+// Buffers of one thread, reused by all queries it runs
+struct QueryScratch {
+    // Number of words, located both in document and query, it's zero for every document not in touchedDocuments
+    vector<uint> summedUpCount;
+    // Documents, which contain at least one word of current query
+    vector<size_t> touchedDocuments;
+    // Bounded heap of best documents with the worst of them on top
+    vector<size_t> bestDocuments;
+    // Marks of removed documents, they are set only while query, which skips them, runs
+    vector<bool> removed;
+};
+// Adding number of word entry in documents to a related variables in vector, remembering new documents
+template <typename Index>
+void AccumulatePostings(const Index& index, string_view word, QueryScratch& scratch) {
+    ForEachPosting(index, word, [&scratch](size_t id, uint count) {
+        if (scratch.summedUpCount[id] == 0)
+            scratch.touchedDocuments.push_back(id);
+        scratch.summedUpCount[id] += count;
+    });
+}
+// Document is better, if it has bigger number of words, or the same number and smaller id
+bool IsBetter(const vector<uint>& summedUpCount, size_t lhs, size_t rhs) {
+    return pair(summedUpCount[lhs], rhs) > pair(summedUpCount[rhs], lhs);
+}
+// Keeping five best of offered documents in heap, so every other document is compared only with the worst
+void OfferDocument(size_t id, QueryScratch& scratch) {
+    auto& [summedUpCount, touchedDocuments, bestDocuments, removed] = scratch;
+    auto isBetter = [&summedUpCount](size_t lhs, size_t rhs) {
+        return IsBetter(summedUpCount, lhs, rhs);
+    };
+
+    if (bestDocuments.size() < MAX_NUMBER_OF_RESULTS) {
+        bestDocuments.push_back(id);
+        push_heap(begin(bestDocuments), end(bestDocuments), isBetter);
+    } else if (isBetter(id, bestDocuments.front())) {
+        pop_heap(begin(bestDocuments), end(bestDocuments), isBetter);
+        bestDocuments.back() = id;
+        push_heap(begin(bestDocuments), end(bestDocuments), isBetter);
+    }
+}
+// Choosing best documents of base, when the longest list of query is read in order of impact. Postings of other words
+// are summed up at first, so every document gets it's exact count at once, when it's read from the longest list, and
+// not read documents can get at most the current count of it. Reading stops, when no one of them could reach
+// the worst of best documents, so the most of list of common word is never read
+void SelectBestOfBase(const ImpactIndex& impactIndex, const vector<string_view>& words, QueryScratch& scratch) {
+    using Posting = ImpactIndex::Posting;
+    struct QueryWord {
+        ImpactIndex::TermPostings postings;
+        // Number of occurrences of word in query
+        uint weight;
+    };
+    thread_local vector<QueryWord> queryWords;
+    // Marks of documents, which count of the longest word is already known
+    thread_local vector<bool> isCounted;
+    auto& [summedUpCount, touchedDocuments, bestDocuments, removed] = scratch;
+
+    queryWords.clear();
+    for (auto word : words) {
+        const auto postings = impactIndex.Lookup(word);
+        if (postings.byImpact.size() == 0)
+            continue;
+
+        auto sameWord = find_if(begin(queryWords), end(queryWords), [&postings](const QueryWord& queryWord) {
+            return queryWord.postings.byImpact.begin() == postings.byImpact.begin();
+        });
+        if (sameWord == end(queryWords))
+            queryWords.push_back({postings, 1});
+        else
+            sameWord->weight++;
+    }
+    if (queryWords.empty())
+        return;
+    // Best documents of one word are just the first ones in order of impact, even with equal counts
+    if (queryWords.size() == 1) {
+        const auto& [postings, weight] = queryWords.front();
+        for (const auto& posting : postings.byImpact) {
+            if (bestDocuments.size() == MAX_NUMBER_OF_RESULTS)
                 break;
+            if (removed[posting.docid])
+                continue;
+            summedUpCount[posting.docid] = posting.hitcount * weight;
+            touchedDocuments.push_back(posting.docid);
+            OfferDocument(posting.docid, scratch);
+        }
+        return;
+    }
+    if (isCounted.size() < impactIndex.GetNumberOfDocuments())
+        isCounted.resize(impactIndex.GetNumberOfDocuments(), false);
+
+    iter_swap(begin(queryWords), max_element(begin(queryWords), end(queryWords),
+                                             [](const QueryWord& lhs, const QueryWord& rhs) {
+                                                 return lhs.postings.byImpact.size() < rhs.postings.byImpact.size();
+                                             }));
+    const auto [longest, weight] = queryWords.front();
+    uint biggestPartial = 0;
+    for (auto word = next(begin(queryWords)); word != end(queryWords); word++)
+        for (const auto& [id, count] : word->postings.byDocid) {
+            if (summedUpCount[id] == 0)
+                touchedDocuments.push_back(id);
+            summedUpCount[id] += count * word->weight;
+            biggestPartial = max(biggestPartial, summedUpCount[id]);
+        }
+    const size_t numberOfPartial = touchedDocuments.size();
+    // Document gets it's exact count and becomes one of candidates to best ones
+    auto count = [&scratch](size_t id, uint longestCount) {
+        if (scratch.summedUpCount[id] == 0)
+            scratch.touchedDocuments.push_back(id);
+        scratch.summedUpCount[id] += longestCount;
+        isCounted[id] = true;
+        OfferDocument(id, scratch);
+    };
+    // Counting by binary search every document with partial count, which could reach the worst of best ones.
+    // It's done only, when it costs less, than reading the rest of the longest list, otherwise reading goes on
+    auto tryToFinish = [&](const Posting* current, uint remaining, uint worstCount) {
+        size_t numberOfCandidates = 0;
+        for (size_t position = 0; position < numberOfPartial; position++) {
+            const size_t id = touchedDocuments[position];
+            if (!isCounted[id] && !removed[id] && summedUpCount[id] + remaining >= worstCount)
+                numberOfCandidates++;
+        }
+        if (numberOfCandidates * 16 > static_cast<size_t>(longest.byImpact.end() - current))
+            return false;
+
+        for (size_t position = 0; position < numberOfPartial; position++) {
+            const size_t id = touchedDocuments[position];
+            if (isCounted[id] || removed[id] || summedUpCount[id] + remaining < worstCount)
+                continue;
+            const auto found = lower_bound(begin(longest.byDocid), end(longest.byDocid), id,
+                                           [](const Posting& posting, size_t docid) {
+                                               return posting.docid < docid;
+                                           });
+            count(id, found != end(longest.byDocid) && found->docid == id ? found->hitcount * weight : 0);
+        }
+        return true;
+    };
+
+    bool isFinished = false;
+    // Check walks over all documents with partial counts, so between checks at least as many postings are read
+    size_t readSinceCheck = 0;
+    for (auto current = longest.byImpact.begin(); current != longest.byImpact.end(); current++) {
+        if (bestDocuments.size() == MAX_NUMBER_OF_RESULTS) {
+            const uint remaining = current->hitcount * weight;
+            const uint worstCount = summedUpCount[bestDocuments.front()];
+            // Not read document with count equal to the worst of best could still have smaller id
+            isFinished = biggestPartial + remaining < worstCount;
+            if (!isFinished && remaining < worstCount && readSinceCheck >= numberOfPartial) {
+                readSinceCheck = 0;
+                isFinished = tryToFinish(current, remaining, worstCount);
             }
+            if (isFinished)
+                break;
+        }
+        readSinceCheck++;
+        if (!removed[current->docid])
+            count(current->docid, current->hitcount * weight);
+    }
+    // When the whole list is read, documents without the longest word have their exact counts too
+    if (!isFinished)
+        for (size_t position = 0; position < numberOfPartial; position++) {
+            const size_t id = touchedDocuments[position];
+            if (!isCounted[id] && !removed[id])
+                OfferDocument(id, scratch);
+        }
+    for (size_t id : touchedDocuments)
+        isCounted[id] = false;
+}
+// Searching five most relevant documents for words of one query in given version of index and writing them
+void ProcessQuery(const vector<string_view>& words, const IndexSnapshot& snapshot, AnswerWriter& writer) {
+    thread_local QueryScratch scratch;
+    auto& [summedUpCount, touchedDocuments, bestDocuments, removed] = scratch;
+    // Counters only grow with base, and they are cleaned after every query, so here they are all zeroes
+    if (summedUpCount.size() < snapshot.numberOfDocuments) {
+        summedUpCount.resize(snapshot.numberOfDocuments, 0);
+        removed.resize(snapshot.numberOfDocuments, false);
+    }
+    bestDocuments.clear();
 
-            search_results_output << " {" << "docid: " << id << ", " << "hitcount: " << count << '}';
+    if (const auto* impactIndex = get_if<ImpactIndex>(snapshot.index.get())) {
+        size_t firstOfSegments = 0;
+        {
+            PROFILE_STAGE(Stage::Accumulation)
+            // Postings of base are read in order of impact and stopped early, so best documents of base are offered
+            // while they're summed up. Documents of segments are offered to them after
+            for (size_t id : snapshot.tombstones)
+                removed[id] = true;
+            SelectBestOfBase(*impactIndex, words, scratch);
+            for (size_t id : snapshot.tombstones)
+                removed[id] = false;
+
+            firstOfSegments = touchedDocuments.size();
+            for (const auto& segment : snapshot.segments)
+                for (auto word : words)
+                    AccumulatePostings(*segment, word, scratch);
+            for (size_t id : snapshot.tombstones)
+                if (id >= impactIndex->GetNumberOfDocuments())
+                    summedUpCount[id] = 0;
+        }
+        PROFILE_STAGE(Stage::TopK)
+        for (size_t position = firstOfSegments; position < touchedDocuments.size(); position++)
+            if (summedUpCount[touchedDocuments[position]] != 0)
+                OfferDocument(touchedDocuments[position], scratch);
+    } else {
+        {
+            PROFILE_STAGE(Stage::Accumulation)
+            // For every word - in base and then in every segment
+            visit([&words](const auto& index) {
+                for (auto word : words)
+                    AccumulatePostings(index, word, scratch);
+            }, *snapshot.index);
+            for (const auto& segment : snapshot.segments)
+                for (auto word : words)
+                    AccumulatePostings(*segment, word, scratch);
+            // Removed documents are answered as empty ones
+            for (size_t id : snapshot.tombstones)
+                summedUpCount[id] = 0;
         }
-        search_results_output << '\n';
+        PROFILE_STAGE(Stage::TopK)
+        // Then keeping five best of touched documents
+        for (size_t id : touchedDocuments)
+            if (summedUpCount[id] != 0)
+                OfferDocument(id, scratch);
     }
+    sort_heap(begin(bestDocuments), end(bestDocuments), [](size_t lhs, size_t rhs) {
+        return IsBetter(scratch.summedUpCount, lhs, rhs);
+    });
+    {
+        PROFILE_STAGE(Stage::Output)
+        // Formatting result to a output buffer including that five biggest numbers and id of related documents
+        for (size_t id : bestDocuments)
+            writer.WriteHit(id, summedUpCount[id]);
+    }
+    // Cleaning only counters, touched by this query
+    for (size_t id : touchedDocuments)
+        summedUpCount[id] = 0;
+    touchedDocuments.clear();
+}
+// Main "search" function - answering part of stream in one thread
+string SearchServer::processQueries(const vector<string>& queries) const {
+    // Answers of the whole part are written to one buffer, it's size is taken from the previous part of thread
+    thread_local size_t expectedSize = 0;
+    string search_results_output;
+    search_results_output.reserve(expectedSize);
+    AnswerWriter writer(search_results_output);
+    // Buffers of thread for words of query, key of it in cache and it's answer
+    thread_local vector<string_view> words;
+    thread_local string key;
+    thread_local string answer;
+    AnswerWriter answerWriter(answer);
+    // For every query
+    for (const auto& query : queries) {
+        // Pinning version of index once, so the whole query is answered by it, even if new one is published
+        const auto currentSnapshot = GetSnapshot();
+        const auto& cache = currentSnapshot->cache;
+        {
+            PROFILE_STAGE(Stage::Tokenization)
+            SplitIntoWordsView(query, words);
+            if (cache != nullptr) {
+                // Order of words doesn't change answer, so queries with the same words share it
+                sort(begin(words), end(words));
+                key.clear();
+                for (auto word : words)
+                    key.append(word).push_back(' ');
+            }
+        }
+
+        if (cache == nullptr) {
+            writer.WriteQuery(query);
+            ProcessQuery(words, *currentSnapshot, writer);
+            writer.EndLine();
+            continue;
+        }
+
+        bool found;
+        {
+            PROFILE_STAGE(Stage::CacheLookup)
+            found = cache->Find(key, answer);
+        }
+        if (found) {
+            cacheHits.fetch_add(1, memory_order_relaxed);
+        } else {
+            cacheMisses.fetch_add(1, memory_order_relaxed);
+            answer.clear();
+            ProcessQuery(words, *currentSnapshot, answerWriter);
+            cache->Insert(key, answer);
+        }
+        PROFILE_STAGE(Stage::Output)
+        writer.WriteQuery(query);
+        writer.WriteText(answer);
+        writer.EndLine();
+    }
+    expectedSize = search_results_output.size();
+
+    return search_results_output;
 }
 // Main "search" function - multi-thread solution
 void SearchServer::AddQueriesStream(istream& query_input, ostream& search_results_output) {
-    futures.push_back(async(AddQueriesStreamSingleThread, ref(query_input), ref(search_results_output),
-                            ref(parsedDocuments), numberOfDocuments));
+    // Limiting number of parts of this stream in work, so one big stream doesn't take the whole queue
+    const size_t maxNumberOfParts = 2 * queryPool.GetNumberOfThreads();
+    // Answers of parts, which are sent to workers, in order of their queries
+    deque<future<string>> answers;
+    // Every part is written by one call, without formatting
+    auto writeFirstAnswer = [&answers, &search_results_output] {
+        const string answer = answers.front().get();
+        answers.pop_front();
+        search_results_output.write(answer.data(), answer.size());
+    };
+    // Splitting stream to parts and sending them to workers
+    while (true) {
+        vector<string> queries;
+        queries.reserve(settings.queriesPerTask);
+        for (string query; queries.size() < max<size_t>(1, settings.queriesPerTask) && getline(query_input, query);)
+            queries.push_back(move(query));
+        if (queries.empty())
+            break;
+
+        if (answers.size() >= maxNumberOfParts)
+            writeFirstAnswer();
+        answers.push_back(queryPool.Submit([this, queries = move(queries)] {
+            return processQueries(queries);
+        }));
+    }
+
+    while (!answers.empty())
+        writeFirstAnswer();
+}
+
+IndexMemoryReport SearchServer::GetMemoryReport() const {
+    const auto currentSnapshot = GetSnapshot();
+    auto report = visit([](const auto& index) {
+        if constexpr (is_same_v<decay_t<decltype(index)>, PostingsMap>)
+            return MeasurePostingsMap(index);
+        else
+            return index.GetMemoryReport();
+    }, *currentSnapshot->index);
+    // Segments are not merged yet, but they take memory too
+    for (const auto& segment : currentSnapshot->segments) {
+        const auto segmentReport = MeasurePostingsMap(*segment);
+        report.numberOfTerms += segmentReport.numberOfTerms;
+        report.numberOfPostings += segmentReport.numberOfPostings;
+        report.termBytes += segmentReport.termBytes;
+        report.postingBytes += segmentReport.postingBytes;
+        report.overheadBytes += segmentReport.overheadBytes;
+    }
+
+    return report;
+}
+
+QueryCacheStatistics SearchServer::GetCacheStatistics() const {
+    return {cacheHits.load(memory_order_relaxed), cacheMisses.load(memory_order_relaxed)};
+}
+
+void SearchServer::SaveIndex(const string& path) const {
+    const auto currentSnapshot = GetSnapshot();
+    // Changes, which are not merged yet, are merged to temporary base
+    const auto index = currentSnapshot->segments.empty() && currentSnapshot->tombstones.empty() ?
+                       currentSnapshot->index : make_shared<const BaseIndex>(MergeChanges(*currentSnapshot));
+    if (!holds_alternative<CompactIndex>(*index))
+        throw logic_error("Only compact index can be saved to file");
+
+    get<CompactIndex>(*index).Save(path);
+}
+
+void SearchServer::OpenIndex(const string& path) {
+    auto newSnapshot = make_shared<IndexSnapshot>();
+    auto newCompactIndex = CompactIndex::Open(path);
+    newSnapshot->numberOfDocuments = newCompactIndex.GetNumberOfDocuments();
+    newSnapshot->index = make_shared<const BaseIndex>(move(newCompactIndex));
+
+    lock_guard guard(updateMutex);
+    newSnapshot->generation = GetSnapshot()->generation + 1;
+    publish(move(newSnapshot));
+}
+
+shared_ptr<const IndexSnapshot> SearchServer::GetSnapshot() const {
+    return atomic_load(&snapshot);
 }
@@ -3,24 +3,119 @@
 #include <iostream>
 #include <unordered_map>
 #include <vector>
+#include <atomic>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <variant>
+
+#include "compact_index.h"
+#include "compressed_index.h"
+#include "impact_index.h"
+#include "query_cache.h"
+#include "thread_pool.h"
 
 using namespace std;
 // Interface for our main class
 vector<string> SplitIntoWords(const string& line);
+// Layout of index, stored by server
+enum class IndexMode {
+    // Map of words to vectors of postings
+    HashMap,
+    // Arena of words and flat buffer of packed postings
+    Compact,
+    // Arena of words and postings, encoded by varints of differences of ids, they are decoded by every query
+    Compressed,
+    // Compact index with postings, also sorted by counts. Queries stop, when the best documents can't change
+    Impact
+};
+
+// Index of the whole base in one of layouts
+using BaseIndex = variant<PostingsMap, CompactIndex, CompressedIndex, ImpactIndex>;
+// Immutable version of index. Every query holds it while running, so new version can be published at any moment
+struct IndexSnapshot {
+    // Versions share base and segments, which didn't change between them
+    shared_ptr<const BaseIndex> index = make_shared<BaseIndex>();
+    // Documents, appended after base was built, every segment covers next range of ids
+    vector<shared_ptr<const PostingsMap>> segments;
+    // Ids of removed documents, which are still present in base or segments
+    vector<size_t> tombstones;
+    size_t numberOfDocuments = 0;
+    // Number of base rebuilds - merge of old base is not published over the new one
+    size_t generation = 0;
+    // Answers, found in this version. Every change of documents brings new empty cache, merge keeps it
+    shared_ptr<QueryCache> cache;
+};
+// Number of queries, answered from cache and answered by index since start of server
+struct QueryCacheStatistics {
+    size_t hits = 0;
+    size_t misses = 0;
+};
 
 class SearchServer {
 public:
-    SearchServer() = default;
+    struct Settings {
+        IndexMode indexMode = IndexMode::HashMap;
+        // Number of threads, indexing chunks of input and then merging their parts of words, zero means all cores
+        size_t buildThreads = 1;
+        // Number of workers, answering queries, zero means all cores
+        size_t queryThreads = 0;
+        // Number of tasks, waiting for free worker, streams wait if there are more
+        size_t queueCapacity = 64;
+        // Number of queries of one stream, answered by one task
+        size_t queriesPerTask = 256;
+        // Number of appended segments and removed documents, after which they are merged to base in background
+        size_t maxSegments = 8;
+        size_t maxTombstones = 1024;
+        // Number of cached answers, zero turns cache off
+        size_t cacheCapacity = 4096;
+    };
+
+    SearchServer() : SearchServer(Settings()) {}
+
+    explicit SearchServer(const Settings& settings);
 
     explicit SearchServer(istream& document_input);
 
+    SearchServer(istream& document_input, const Settings& settings);
+
     void UpdateDocumentBase(istream& document_input);
+    // Appending documents after existing ones, they get next ids
+    void AddDocuments(istream& document_input);
+    // Removed document keeps it's id, it's answered as if it's empty
+    void RemoveDocument(size_t docid);
 
+    // Answers are written in order of queries. Several streams may be added from different threads at once
     void AddQueriesStream(istream& query_input, ostream& search_results_output);
 
+    [[nodiscard]] IndexMemoryReport GetMemoryReport() const;
+
+    [[nodiscard]] QueryCacheStatistics GetCacheStatistics() const;
+    // Writing current index with all changes to file, only compact index can be written
+    void SaveIndex(const string& path) const;
+    // Replacing index by one, mapped from file, which was written by SaveIndex
+    void OpenIndex(const string& path);
+    // Taking version of index, actual at the moment of call
+    [[nodiscard]] shared_ptr<const IndexSnapshot> GetSnapshot() const;
+
 private:
-    size_t numberOfDocuments = 0;
-    unordered_map<string, vector<pair<size_t, uint>>> parsedDocuments;
-    vector<future<void>> futures;
+    Settings settings;
+    // Replaced only by atomic store, so readers never wait for rebuild and rebuild never waits for readers
+    shared_ptr<const IndexSnapshot> snapshot = make_shared<IndexSnapshot>();
+    ThreadPool queryPool;
+    // Writers publish versions one by one, readers never take it
+    mutex updateMutex;
+    // Merge of segments and tombstones to base, running in background
+    bool merging = false;
+    future<void> mergeTask;
+    mutable atomic<size_t> cacheHits{0};
+    mutable atomic<size_t> cacheMisses{0};
+
+    void publish(shared_ptr<IndexSnapshot> newSnapshot, bool keepCache = false);
+
+    void scheduleMerge(const IndexSnapshot& currentSnapshot);
+
+    void mergeInBackground();
+
+    [[nodiscard]] string processQueries(const vector<string>& queries) const;
 };
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "search_server.h"
+
+using namespace std;
+using namespace std::chrono;
+// Benchmark of the whole server on generated base: building, queries by one stream and by several of them, and
+// latency of queries, sent one at a time. Built with sources of server, without tests and other tools:
+// g++ -O2 -pthread search_server_benchmark.cpp $(ls *.cpp | grep -v '_test\|_benchmark')
+// Base and server are set by options like --documents=20000 --mode=compressed, see ParseArguments. Output is a JSON
+// line for settings, build, single_stream, multi_stream and latency, so runs are easy to compare by script
+struct BenchmarkSettings {
+    size_t seed = 42;
+    size_t vocabularySize = 10'000;
+    // Exponent of Zipf distribution of words, zero means uniform one
+    double skew = 1.0;
+    size_t numberOfDocuments = 20'000;
+    size_t wordsPerDocument = 100;
+    size_t numberOfQueries = 10'000;
+    size_t wordsPerQuery = 5;
+    size_t numberOfStreams = 4;
+    // Number of queries, sent one by one to measure latency of every one of them
+    size_t latencyQueries = 1'000;
+    IndexMode indexMode = IndexMode::Compact;
+    SearchServer::Settings server;
+};
+
+IndexMode ParseIndexMode(const string& name) {
+    if (name == "hashmap")
+        return IndexMode::HashMap;
+    if (name == "compact")
+        return IndexMode::Compact;
+    if (name == "compressed")
+        return IndexMode::Compressed;
+    if (name == "impact")
+        return IndexMode::Impact;
+    throw invalid_argument("Unknown index mode " + name);
+}
+
+const char* GetIndexModeName(IndexMode indexMode) {
+    switch (indexMode) {
+        case IndexMode::HashMap:
+            return "hashmap";
+        case IndexMode::Compact:
+            return "compact";
+        case IndexMode::Compressed:
+            return "compressed";
+        case IndexMode::Impact:
+            return "impact";
+    }
+
+    return "unknown";
+}
+
+BenchmarkSettings ParseArguments(int argc, char* argv[]) {
+    BenchmarkSettings settings;
+    // Queries repeat between phases, so cache is off, unless it's asked for
+    settings.server.cacheCapacity = 0;
+    for (int argument = 1; argument < argc; argument++) {
+        const string text = argv[argument];
+        const size_t equalSign = text.find('=');
+        if (text.substr(0, 2) != "--" || equalSign == string::npos)
+            throw invalid_argument("Option should look like --name=value, got " + text);
+        const string name = text.substr(2, equalSign - 2);
+        const string value = text.substr(equalSign + 1);
+
+        if (name == "seed")
+            settings.seed = stoul(value);
+        else if (name == "vocabulary")
+            settings.vocabularySize = stoul(value);
+        else if (name == "skew")
+            settings.skew = stod(value);
+        else if (name == "documents")
+            settings.numberOfDocuments = stoul(value);
+        else if (name == "document-length")
+            settings.wordsPerDocument = stoul(value);
+        else if (name == "queries")
+            settings.numberOfQueries = stoul(value);
+        else if (name == "query-length")
+            settings.wordsPerQuery = stoul(value);
+        else if (name == "streams")
+            settings.numberOfStreams = stoul(value);
+        else if (name == "latency-queries")
+            settings.latencyQueries = stoul(value);
+        else if (name == "mode")
+            settings.indexMode = ParseIndexMode(value);
+        else if (name == "build-threads")
+            settings.server.buildThreads = stoul(value);
+        else if (name == "query-threads")
+            settings.server.queryThreads = stoul(value);
+        else if (name == "cache")
+            settings.server.cacheCapacity = stoul(value);
+        else
+            throw invalid_argument("Unknown option " + name);
+    }
+    settings.server.indexMode = settings.indexMode;
+    if (settings.vocabularySize == 0)
+        throw invalid_argument("Vocabulary can't be empty");
+
+    return settings;
+}
+// Word of rank r is chosen with probability, proportional to 1 / r^skew
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t vocabularySize, double skew, size_t seed) : generator(seed), cumulative(vocabularySize) {
+        double sum = 0;
+        for (size_t rank = 0; rank < vocabularySize; rank++)
+            cumulative[rank] = sum += 1 / pow(static_cast<double>(rank + 1), skew);
+        distribution = uniform_real_distribution<double>(0, sum);
+    }
+
+    size_t Next() {
+        const auto position = upper_bound(begin(cumulative), end(cumulative), distribution(generator));
+        return min<size_t>(position - begin(cumulative), cumulative.size() - 1);
+    }
+
+    string GenerateLines(size_t numberOfLines, size_t wordsPerLine) {
+        string text;
+        for (size_t line = 0; line < numberOfLines; line++) {
+            for (size_t word = 0; word < wordsPerLine; word++) {
+                text += word != 0 ? " w" : "w";
+                text += to_string(Next());
+            }
+            text += '\n';
+        }
+
+        return text;
+    }
+
+private:
+    mt19937_64 generator;
+    vector<double> cumulative;
+    uniform_real_distribution<double> distribution;
+};
+
+double ToSeconds(steady_clock::duration duration) {
+    return duration_cast<microseconds>(duration).count() / 1e6;
+}
+
+template <typename Function>
+steady_clock::duration Measure(Function function) {
+    const auto start = steady_clock::now();
+    function();
+    return steady_clock::now() - start;
+}
+
+void PrintSettings(const BenchmarkSettings& settings) {
+    cout << "{\"phase\": \"settings\", "
+         << "\"mode\": \"" << GetIndexModeName(settings.indexMode) << "\", "
+         << "\"seed\": " << settings.seed << ", "
+         << "\"vocabulary\": " << settings.vocabularySize << ", "
+         << "\"skew\": " << settings.skew << ", "
+         << "\"documents\": " << settings.numberOfDocuments << ", "
+         << "\"document_length\": " << settings.wordsPerDocument << ", "
+         << "\"queries\": " << settings.numberOfQueries << ", "
+         << "\"query_length\": " << settings.wordsPerQuery << ", "
+         << "\"streams\": " << settings.numberOfStreams << ", "
+         << "\"build_threads\": " << settings.server.buildThreads << ", "
+         << "\"query_threads\": " << settings.server.queryThreads << ", "
+         << "\"cache\": " << settings.server.cacheCapacity << "}" << endl;
+}
+
+void PrintThroughput(const string& phase, size_t numberOfQueries, steady_clock::duration elapsed) {
+    const double seconds = ToSeconds(elapsed);
+    cout << "{\"phase\": \"" << phase << "\", "
+         << "\"queries\": " << numberOfQueries << ", "
+         << "\"seconds\": " << seconds << ", "
+         << "\"queries_per_second\": " << (seconds > 0 ? numberOfQueries / seconds : 0) << "}" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkSettings settings;
+    try {
+        settings = ParseArguments(argc, argv);
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    PrintSettings(settings);
+
+    ZipfGenerator generator(settings.vocabularySize, settings.skew, settings.seed);
+    const string documents = generator.GenerateLines(settings.numberOfDocuments, settings.wordsPerDocument);
+    const string queries = generator.GenerateLines(settings.numberOfQueries, settings.wordsPerQuery);
+    // Phase of building, then all queries by one stream, then by several streams at once
+    SearchServer server(settings.server);
+    const auto buildTime = Measure([&server, &documents] {
+        istringstream documentInput(documents);
+        server.UpdateDocumentBase(documentInput);
+    });
+    const auto report = server.GetMemoryReport();
+    cout << "{\"phase\": \"build\", "
+         << "\"documents\": " << settings.numberOfDocuments << ", "
+         << "\"seconds\": " << ToSeconds(buildTime) << ", "
+         << "\"documents_per_second\": " << settings.numberOfDocuments / max(ToSeconds(buildTime), 1e-6) << ", "
+         << "\"terms\": " << report.numberOfTerms << ", "
+         << "\"postings\": " << report.numberOfPostings << ", "
+         << "\"index_bytes\": " << report.TotalBytes() << "}" << endl;
+
+    const auto singleStreamTime = Measure([&server, &queries] {
+        istringstream queryInput(queries);
+        ostringstream output;
+        server.AddQueriesStream(queryInput, output);
+    });
+    PrintThroughput("single_stream", settings.numberOfQueries, singleStreamTime);
+
+    const auto multiStreamTime = Measure([&server, &queries, &settings] {
+        vector<future<void>> streams;
+        for (size_t stream = 0; stream < settings.numberOfStreams; stream++)
+            streams.push_back(async(launch::async, [&server, &queries] {
+                istringstream queryInput(queries);
+                ostringstream output;
+                server.AddQueriesStream(queryInput, output);
+            }));
+        for (auto& stream : streams)
+            stream.get();
+    });
+    PrintThroughput("multi_stream", settings.numberOfStreams * settings.numberOfQueries, multiStreamTime);
+    // Latency is measured by queries, sent one at a time, so it includes the way through pool of workers
+    istringstream queryInput(queries);
+    vector<double> latencies;
+    for (string query; latencies.size() < settings.latencyQueries && getline(queryInput, query);) {
+        istringstream singleQueryInput(query);
+        ostringstream output;
+        latencies.push_back(duration_cast<nanoseconds>(Measure([&server, &singleQueryInput, &output] {
+            server.AddQueriesStream(singleQueryInput, output);
+        })).count() / 1e3);
+    }
+    sort(begin(latencies), end(latencies));
+    auto percentile = [&latencies](double part) {
+        if (latencies.empty())
+            return 0.0;
+        return latencies[min(latencies.size() - 1, static_cast<size_t>(part * latencies.size()))];
+    };
+    cout << "{\"phase\": \"latency\", "
+         << "\"queries\": " << latencies.size() << ", "
+         << "\"p50_us\": " << percentile(0.5) << ", "
+         << "\"p99_us\": " << percentile(0.99) << ", "
+         << "\"max_us\": " << (latencies.empty() ? 0 : latencies.back()) << "}" << endl;
+
+    return 0;
+}
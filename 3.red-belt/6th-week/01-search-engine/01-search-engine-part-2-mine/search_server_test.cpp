@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "search_server.h"
+#include "stage_profiler.h"
+#include "tokenizer.h"
+#include "test_runner.h"
+
+using namespace std;
+// Tests of search server. Call them from main by TestRunner, as usual
+string GenerateLines(size_t seed, size_t numberOfLines, size_t vocabularySize, size_t maxWords) {
+    mt19937 generator(seed);
+    ostringstream output;
+
+    for (size_t line = 0; line < numberOfLines; line++) {
+        const size_t numberOfWords = generator() % (maxWords + 1);
+        for (size_t word = 0; word < numberOfWords; word++)
+            output << (word != 0 ? " " : "") << 'w' << generator() % vocabularySize;
+        output << '\n';
+    }
+
+    return output.str();
+}
+
+vector<string> SplitIntoLines(const string& text) {
+    istringstream input(text);
+    vector<string> lines;
+    for (string line; getline(input, line);)
+        lines.push_back(move(line));
+
+    return lines;
+}
+
+vector<string> AnswerQueries(const string& documents, const string& queries, const SearchServer::Settings& settings) {
+    istringstream documentInput(documents);
+    istringstream queryInput(queries);
+    ostringstream output;
+    {
+        SearchServer server(documentInput, settings);
+        server.AddQueriesStream(queryInput, output);
+    }
+
+    return SplitIntoLines(output.str());
+}
+// Updates run all the time, while 16 streams send queries - every answer should come from one version of base
+void TestSnapshotConsistency() {
+    const size_t numberOfBases = 8;
+    const size_t numberOfStreams = 16;
+    const size_t numberOfUpdates = 64;
+    const size_t numberOfRepeats = 20;
+
+    const string queries = GenerateLines(numberOfBases, 100, 50, 6);
+    vector<string> bases;
+    for (size_t seed = 0; seed < numberOfBases; seed++)
+        bases.push_back(GenerateLines(seed, 300 + seed * 20, 50, 30));
+
+    for (const auto indexMode : {IndexMode::HashMap, IndexMode::Compact, IndexMode::Compressed, IndexMode::Impact}) {
+        const SearchServer::Settings settings = {indexMode, 2};
+        // Answers, which each query can get from any version of base
+        vector<set<string>> allowedAnswers;
+        for (const auto& base : bases) {
+            const auto answers = AnswerQueries(base, queries, settings);
+            allowedAnswers.resize(answers.size());
+            for (size_t query = 0; query < answers.size(); query++)
+                allowedAnswers[query].insert(answers[query]);
+        }
+
+        string repeatedQueries;
+        for (size_t repeat = 0; repeat < numberOfRepeats; repeat++)
+            repeatedQueries += queries;
+
+        vector<istringstream> queryInputs;
+        vector<ostringstream> outputs(numberOfStreams);
+        for (size_t stream = 0; stream < numberOfStreams; stream++)
+            queryInputs.emplace_back(repeatedQueries);
+
+        {
+            istringstream documentInput(bases.front());
+            SearchServer server(documentInput, settings);
+
+            thread updater([&server, &bases] {
+                for (size_t update = 1; update <= numberOfUpdates; update++) {
+                    istringstream newDocumentInput(bases[update % bases.size()]);
+                    server.UpdateDocumentBase(newDocumentInput);
+                }
+            });
+
+            vector<future<void>> streams;
+            for (size_t stream = 0; stream < numberOfStreams; stream++)
+                streams.push_back(async(launch::async, [&server, &queryInputs, &outputs, stream] {
+                    server.AddQueriesStream(queryInputs[stream], outputs[stream]);
+                }));
+
+            for (auto& stream : streams)
+                stream.get();
+            updater.join();
+        }
+
+        for (const auto& output : outputs) {
+            const auto answers = SplitIntoLines(output.str());
+            ASSERT_EQUAL(answers.size(), numberOfRepeats * allowedAnswers.size())
+            for (size_t line = 0; line < answers.size(); line++)
+                ASSERT(allowedAnswers[line % allowedAnswers.size()].count(answers[line]) != 0)
+        }
+    }
+}
+// One big stream is split to many small tasks, but answers should still come in order of queries
+void TestLargeStreamOrder() {
+    const string documents = GenerateLines(1, 500, 100, 30);
+    const string queries = GenerateLines(2, 5000, 120, 6);
+
+    SearchServer::Settings serialSettings;
+    serialSettings.queryThreads = 1;
+    serialSettings.queriesPerTask = 5000;
+    SearchServer::Settings splitSettings;
+    splitSettings.queryThreads = 4;
+    splitSettings.queueCapacity = 2;
+    splitSettings.queriesPerTask = 7;
+
+    ASSERT_EQUAL(AnswerQueries(documents, queries, splitSettings), AnswerQueries(documents, queries, serialSettings))
+}
+// Index, mapped from file, should answer exactly like index, from which file was written
+void TestSaveAndOpenIndex() {
+    const string path = "search_server_test.index";
+    const string queries = GenerateLines(4, 300, 120, 6);
+
+    for (const string& documents : {GenerateLines(3, 400, 100, 30), string()}) {
+        SearchServer::Settings settings;
+        settings.indexMode = IndexMode::Compact;
+        {
+            istringstream documentInput(documents);
+            SearchServer(documentInput, settings).SaveIndex(path);
+        }
+
+        SearchServer server;
+        server.OpenIndex(path);
+        istringstream queryInput(queries);
+        ostringstream output;
+        server.AddQueriesStream(queryInput, output);
+        remove(path.c_str());
+
+        ASSERT_EQUAL(SplitIntoLines(output.str()), AnswerQueries(documents, queries, settings))
+    }
+}
+// Posting of document, which isn't in index, is found, when file is opened, not by query, which counts its hits
+void TestOpenCorruptedIndex() {
+    const string path = "search_server_test.index";
+    {
+        istringstream documentInput("a\n");
+        SearchServer::Settings settings;
+        settings.indexMode = IndexMode::Compact;
+        SearchServer(documentInput, settings).SaveIndex(path);
+    }
+    {
+        // The only posting is followed only by the only word
+        fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekp(-static_cast<streamoff>(sizeof(CompactIndex::Posting) + 1), ios::end);
+        const uint32_t docid = 1;
+        file.write(reinterpret_cast<const char*>(&docid), sizeof(docid));
+    }
+
+    // Opening doesn't read postings, so wrong document is found by first query of it's word
+    SearchServer server;
+    server.OpenIndex(path);
+    remove(path.c_str());
+    bool thrown = false;
+    try {
+        istringstream queryInput("a\n");
+        ostringstream queryOutput;
+        server.AddQueriesStream(queryInput, queryOutput);
+    } catch (const runtime_error&) {
+        thrown = true;
+    }
+    ASSERT(thrown)
+}
+// Splitting by views should find the same words, as stream does, including all kinds of whitespace
+void TestSplitIntoWordsView() {
+    mt19937 generator(7);
+    const string alphabet = "ab \t\n\v\f\r";
+
+    for (size_t length = 0; length < 200; length++) {
+        string line;
+        for (size_t position = 0; position < length; position++)
+            line.push_back(alphabet[generator() % alphabet.size()]);
+
+        istringstream input(line);
+        const vector<string> expected = {istream_iterator<string>(input), istream_iterator<string>()};
+        const auto words = SplitIntoWordsView(line);
+        ASSERT_EQUAL(vector<string>(begin(words), end(words)), expected)
+    }
+}
+// Appended and removed documents should be answered exactly like base, rebuilt from scratch, before and after merge
+void TestIncrementalUpdates() {
+    const string queries = GenerateLines(5, 100, 60, 6);
+
+    for (const auto indexMode : {IndexMode::HashMap, IndexMode::Compact, IndexMode::Compressed, IndexMode::Impact}) {
+        SearchServer::Settings settings;
+        settings.indexMode = indexMode;
+        settings.maxSegments = 2;
+        settings.maxTombstones = 3;
+
+        auto documents = SplitIntoLines(GenerateLines(6, 200, 50, 20));
+        string base;
+        for (const auto& document : documents)
+            base += document + '\n';
+        istringstream documentInput(base);
+        SearchServer server(documentInput, settings);
+
+        mt19937 generator(8);
+        for (size_t step = 0; step < 40; step++) {
+            if (generator() % 2 == 0) {
+                const auto newDocuments = SplitIntoLines(GenerateLines(100 + step, 1 + generator() % 20, 50, 20));
+                string appended;
+                for (const auto& document : newDocuments)
+                    appended += document + '\n';
+                istringstream appendedInput(appended);
+                server.AddDocuments(appendedInput);
+                documents.insert(end(documents), begin(newDocuments), end(newDocuments));
+            } else {
+                const size_t docid = generator() % documents.size();
+                server.RemoveDocument(docid);
+                documents[docid].clear();
+            }
+
+            string rebuilt;
+            for (const auto& document : documents)
+                rebuilt += document + '\n';
+            istringstream queryInput(queries);
+            ostringstream output;
+            server.AddQueriesStream(queryInput, output);
+            ASSERT_EQUAL(SplitIntoLines(output.str()), AnswerQueries(rebuilt, queries, settings))
+        }
+    }
+}
+// Cached answers should be the same as computed ones, and they should be forgotten, when base changes
+void TestQueryCache() {
+    // Few different queries, repeated many times, some of them with words in other order
+    const auto distinctQueries = SplitIntoLines(GenerateLines(9, 30, 40, 4));
+    mt19937 generator(10);
+    string queries;
+    for (size_t query = 0; query < 600; query++) {
+        auto words = SplitIntoWords(distinctQueries[generator() % distinctQueries.size()]);
+        shuffle(begin(words), end(words), generator);
+        for (const auto& word : words)
+            queries += word + ' ';
+        queries += '\n';
+    }
+
+    for (const size_t cacheCapacity : {8, 4096}) {
+        SearchServer::Settings settings;
+        settings.cacheCapacity = cacheCapacity;
+        SearchServer::Settings uncachedSettings;
+        uncachedSettings.cacheCapacity = 0;
+        SearchServer server(settings);
+        for (size_t seed = 11; seed <= 12; seed++) {
+            const string base = GenerateLines(seed, 300, 40, 20);
+            istringstream documentInput(base);
+            server.UpdateDocumentBase(documentInput);
+
+            istringstream queryInput(queries);
+            ostringstream output;
+            server.AddQueriesStream(queryInput, output);
+            ASSERT_EQUAL(SplitIntoLines(output.str()), AnswerQueries(base, queries, uncachedSettings))
+        }
+
+        const auto statistics = server.GetCacheStatistics();
+        ASSERT_EQUAL(statistics.hits + statistics.misses, 1200u)
+        ASSERT(statistics.hits > 0)
+    }
+}
+// Every stage of search should be measured in every mode of index, when profiling isn't turned off
+void TestStageStatistics() {
+#ifndef SEARCH_DISABLE_STAGE_PROFILING
+    const size_t numberOfQueries = 500;
+    for (const auto indexMode : {IndexMode::HashMap, IndexMode::Compact, IndexMode::Compressed, IndexMode::Impact}) {
+        SearchServer::Settings settings;
+        settings.indexMode = indexMode;
+        ResetStageStatistics();
+        AnswerQueries(GenerateLines(13, 200, 50, 20), GenerateLines(14, numberOfQueries, 50, 5), settings);
+
+        for (const auto& stageStatistics : GetStageStatistics()) {
+            if (stageStatistics.stage == Stage::Merge)
+                ASSERT_EQUAL(stageStatistics.count, 0u)
+            else if (stageStatistics.stage == Stage::Build)
+                ASSERT_EQUAL(stageStatistics.count, 1u)
+            else
+                ASSERT(stageStatistics.count >= numberOfQueries / 2)
+            ASSERT(stageStatistics.p50 <= stageStatistics.p99)
+            ASSERT(stageStatistics.count == 0 || stageStatistics.p99 > 0ns)
+        }
+    }
+#endif
+}
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <mutex>
+
+#include "stage_profiler.h"
+
+// Histogram of durations in nanoseconds. Durations below four have their own buckets, others are split by highest
+// bit and two bits after it, so there are four buckets for every power of two
+const size_t SUB_BUCKET_BITS = 2;
+const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+const size_t NUMBER_OF_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+size_t GetBucket(uint64_t value) {
+    if (value < SUB_BUCKETS)
+        return value;
+
+    const size_t highestBit = 63 - __builtin_clzll(value);
+    const size_t subBucket = (value >> (highestBit - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (highestBit - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+}
+// Smallest value of bucket after given one
+uint64_t GetBucketEnd(size_t bucket) {
+    if (bucket + 1 < SUB_BUCKETS)
+        return bucket + 1;
+
+    const size_t highestBit = (bucket + 1) / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const uint64_t subBucket = (bucket + 1) % SUB_BUCKETS;
+    if (highestBit >= 62)
+        return numeric_limits<int64_t>::max();
+    return (SUB_BUCKETS + subBucket) << (highestBit - SUB_BUCKET_BITS);
+}
+
+// Counters are written only by their own thread, but they are atomic, because statistics can be read at any time
+struct StageCounters {
+    array<atomic<uint64_t>, NUMBER_OF_BUCKETS> buckets = {};
+    atomic<uint64_t> count{0};
+    atomic<uint64_t> totalNanoseconds{0};
+
+    void Add(uint64_t durationNanoseconds) {
+        buckets[GetBucket(durationNanoseconds)].fetch_add(1, memory_order_relaxed);
+        count.fetch_add(1, memory_order_relaxed);
+        totalNanoseconds.fetch_add(durationNanoseconds, memory_order_relaxed);
+    }
+};
+
+using ThreadStages = array<StageCounters, NUMBER_OF_STAGES>;
+// Counters of all live threads and sum of counters of finished ones
+struct StageRegistry {
+    mutex m;
+    vector<ThreadStages*> threads;
+    ThreadStages finished;
+};
+
+StageRegistry& GetRegistry() {
+    static StageRegistry registry;
+    return registry;
+}
+
+void AddCounters(ThreadStages& destination, const ThreadStages& source) {
+    for (size_t stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+        const auto& counters = source[stage];
+        for (size_t bucket = 0; bucket < NUMBER_OF_BUCKETS; bucket++)
+            if (const uint64_t number = counters.buckets[bucket].load(memory_order_relaxed); number != 0)
+                destination[stage].buckets[bucket].fetch_add(number, memory_order_relaxed);
+        destination[stage].count.fetch_add(counters.count.load(memory_order_relaxed), memory_order_relaxed);
+        destination[stage].totalNanoseconds.fetch_add(counters.totalNanoseconds.load(memory_order_relaxed),
+                                                      memory_order_relaxed);
+    }
+}
+// Counters of one thread, which are registered with it's first measurement and kept after it's finish
+class ThreadRegistration {
+public:
+    ThreadRegistration() {
+        auto& registry = GetRegistry();
+        lock_guard guard(registry.m);
+        registry.threads.push_back(&stages);
+    }
+
+    ~ThreadRegistration() {
+        auto& registry = GetRegistry();
+        lock_guard guard(registry.m);
+        AddCounters(registry.finished, stages);
+        registry.threads.erase(find(begin(registry.threads), end(registry.threads), &stages));
+    }
+
+    ThreadStages stages;
+};
+
+const char* GetStageName(Stage stage) {
+    switch (stage) {
+        case Stage::Build:
+            return "Build";
+        case Stage::Merge:
+            return "Merge";
+        case Stage::Tokenization:
+            return "Tokenization";
+        case Stage::CacheLookup:
+            return "Cache lookup";
+        case Stage::Accumulation:
+            return "Accumulation";
+        case Stage::TopK:
+            return "Top-k";
+        case Stage::Output:
+            return "Output";
+    }
+
+    return "Unknown";
+}
+
+void RecordStage(Stage stage, steady_clock::duration duration) {
+    thread_local ThreadRegistration registration;
+    const int64_t durationNanoseconds = duration_cast<nanoseconds>(duration).count();
+    registration.stages[static_cast<size_t>(stage)].Add(static_cast<uint64_t>(max<int64_t>(0, durationNanoseconds)));
+}
+
+vector<StageStatistics> GetStageStatistics() {
+    ThreadStages total;
+    {
+        auto& registry = GetRegistry();
+        lock_guard guard(registry.m);
+        AddCounters(total, registry.finished);
+        for (const auto* stages : registry.threads)
+            AddCounters(total, *stages);
+    }
+
+    vector<StageStatistics> statistics;
+    for (size_t stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+        const auto& counters = total[stage];
+        StageStatistics stageStatistics;
+        stageStatistics.stage = static_cast<Stage>(stage);
+        stageStatistics.count = counters.count.load(memory_order_relaxed);
+        stageStatistics.total = nanoseconds(counters.totalNanoseconds.load(memory_order_relaxed));
+        // Walking over buckets until the needed part of measurements is passed
+        uint64_t passed = 0;
+        const uint64_t median = (stageStatistics.count + 1) / 2;
+        const uint64_t percentile99 = stageStatistics.count - stageStatistics.count / 100;
+        for (size_t bucket = 0; bucket < NUMBER_OF_BUCKETS && passed < stageStatistics.count; bucket++) {
+            const uint64_t number = counters.buckets[bucket].load(memory_order_relaxed);
+            if (passed < median && passed + number >= median)
+                stageStatistics.p50 = nanoseconds(GetBucketEnd(bucket));
+            if (passed < percentile99 && passed + number >= percentile99)
+                stageStatistics.p99 = nanoseconds(GetBucketEnd(bucket));
+            passed += number;
+        }
+        statistics.push_back(stageStatistics);
+    }
+
+    return statistics;
+}
+
+void ResetStageStatistics() {
+    auto& registry = GetRegistry();
+    lock_guard guard(registry.m);
+    // Other threads may add measurements meanwhile, they are either kept or cleaned, but never broken
+    auto clean = [](ThreadStages& stages) {
+        for (auto& counters : stages) {
+            for (auto& bucket : counters.buckets)
+                bucket.store(0, memory_order_relaxed);
+            counters.count.store(0, memory_order_relaxed);
+            counters.totalNanoseconds.store(0, memory_order_relaxed);
+        }
+    };
+    clean(registry.finished);
+    for (auto* stages : registry.threads)
+        clean(*stages);
+}
+
+ostream& operator <<(ostream& output, const vector<StageStatistics>& statistics) {
+    for (const auto& stageStatistics : statistics)
+        output << GetStageName(stageStatistics.stage) << ": "
+               << "count " << stageStatistics.count << ", "
+               << "total " << duration_cast<microseconds>(stageStatistics.total).count() << " us, "
+               << "p50 " << stageStatistics.p50.count() << " ns, "
+               << "p99 " << stageStatistics.p99.count() << " ns" << '\n';
+    return output;
+}
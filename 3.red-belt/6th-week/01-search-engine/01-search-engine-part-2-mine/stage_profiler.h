@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+// Stages of search, time of which is measured separately
+enum class Stage {
+    // Building of new base from documents
+    Build,
+    // Merge of appended and removed documents to base
+    Merge,
+    // Splitting query to words and making key of it
+    Tokenization,
+    // Search of answer in cache
+    CacheLookup,
+    // Summing up counts of words from postings
+    Accumulation,
+    // Choosing of five best documents
+    TopK,
+    // Formatting and writing of answers
+    Output
+};
+
+const size_t NUMBER_OF_STAGES = static_cast<size_t>(Stage::Output) + 1;
+
+const char* GetStageName(Stage stage);
+// Adding one measurement to histogram of current thread. Threads never wait for each other here
+void RecordStage(Stage stage, steady_clock::duration duration);
+// Statistics of one stage, summed over all threads. Percentiles are upper bounds of their histogram buckets,
+// which are a quarter of power of two wide, so they overestimate real time by 25% at most
+struct StageStatistics {
+    Stage stage;
+    uint64_t count = 0;
+    nanoseconds total{0};
+    nanoseconds p50{0};
+    nanoseconds p99{0};
+};
+// Statistics of all stages, it can be taken at any time, while search runs
+vector<StageStatistics> GetStageStatistics();
+
+void ResetStageStatistics();
+
+ostream& operator <<(ostream& output, const vector<StageStatistics>& statistics);
+// Measuring time from creation to destruction
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage(stage), start(steady_clock::now()) {}
+
+    StageTimer(const StageTimer&) = delete;
+
+    StageTimer& operator =(const StageTimer&) = delete;
+
+    ~StageTimer() {
+        RecordStage(stage, steady_clock::now() - start);
+    }
+
+private:
+    Stage stage;
+    steady_clock::time_point start;
+};
+
+#define STAGE_TIMER_ID_IMPL(lineno) stageTimer##lineno
+#define STAGE_TIMER_ID(lineno) STAGE_TIMER_ID_IMPL(lineno)
+// Measuring the rest of current scope. Compile with SEARCH_DISABLE_STAGE_PROFILING to remove all measurements
+#ifdef SEARCH_DISABLE_STAGE_PROFILING
+#define PROFILE_STAGE(stage)
+#else
+#define PROFILE_STAGE(stage) \
+    StageTimer STAGE_TIMER_ID(__LINE__){stage};
+#endif
@@ -0,0 +1,38 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t numberOfThreads, size_t queueCapacity) : queueCapacity(max<size_t>(1, queueCapacity)) {
+    numberOfThreads = max<size_t>(1, numberOfThreads);
+    workers.reserve(numberOfThreads);
+    for (size_t worker = 0; worker < numberOfThreads; worker++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(m);
+        stopping = true;
+    }
+    notEmpty.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::work() {
+    while (true) {
+        unique_lock lock(m);
+        notEmpty.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty())
+            return;
+
+        auto task = move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        // Place in queue became free, so one of waiting submitters may continue
+        notFull.notify_one();
+
+        task();
+    }
+}
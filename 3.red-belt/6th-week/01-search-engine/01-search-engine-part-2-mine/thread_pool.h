@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+// Fixed number of workers, taking tasks from bounded queue. If queue is full, the one who submits waits
+class ThreadPool {
+public:
+    ThreadPool(size_t numberOfThreads, size_t queueCapacity);
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator =(const ThreadPool&) = delete;
+    // Workers finish all submitted tasks before stopping
+    ~ThreadPool();
+
+    template <typename Task>
+    future<invoke_result_t<Task>> Submit(Task task) {
+        // Packaged task can't be copied, so function holds pointer to it
+        auto packagedTask = make_shared<packaged_task<invoke_result_t<Task>()>>(move(task));
+        auto result = packagedTask->get_future();
+
+        unique_lock lock(m);
+        notFull.wait(lock, [this] { return tasks.size() < queueCapacity; });
+        tasks.emplace_back([packagedTask] { (*packagedTask)(); });
+        lock.unlock();
+        notEmpty.notify_one();
+
+        return result;
+    }
+
+    [[nodiscard]] size_t GetNumberOfThreads() const {
+        return workers.size();
+    }
+
+private:
+    const size_t queueCapacity;
+    mutex m;
+    condition_variable notEmpty;
+    condition_variable notFull;
+    deque<function<void()>> tasks;
+    bool stopping = false;
+    vector<thread> workers;
+
+    void work();
+};
@@ -0,0 +1,91 @@
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "tokenizer.h"
+// Whitespace of stream is space and characters from '\t' to '\r'
+bool IsSpace(char c) {
+    return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+#if defined(__AVX2__)
+const size_t BLOCK_SIZE = 32;
+// Bit i of result is set if data[i] is whitespace
+uint32_t GetSpaceMask(const char* data) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const __m256i spaces = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    // Unsigned shifted byte is not bigger than it's minimum with limit only if it's in range
+    const __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8('\t'));
+    const __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(spaces, controls)));
+}
+#elif defined(__SSE2__)
+const size_t BLOCK_SIZE = 16;
+// Bit i of result is set if data[i] is whitespace
+uint32_t GetSpaceMask(const char* data) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    // Unsigned shifted byte is not bigger than it's minimum with limit only if it's in range
+    const __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+    const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(spaces, controls)));
+}
+#else
+const size_t BLOCK_SIZE = 0;
+#endif
+
+void SplitIntoWordsView(string_view line, vector<string_view>& words) {
+    words.clear();
+    // Beginning of current word, if we are inside of it
+    size_t wordStart = 0;
+    bool insideWord = false;
+    size_t position = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    // Looking at whole block at once - words begin where whitespace ends, and end where it begins
+    const auto blockBits = static_cast<uint32_t>((uint64_t(1) << BLOCK_SIZE) - 1);
+    for (; position + BLOCK_SIZE <= line.size(); position += BLOCK_SIZE) {
+        const uint32_t spaceMask = GetSpaceMask(line.data() + position);
+        // Bit i is set if previous character is whitespace
+        const uint32_t previousSpaceMask = ((spaceMask << 1) | (insideWord ? 0 : 1)) & blockBits;
+        const uint32_t starts = ~spaceMask & previousSpaceMask & blockBits;
+        const uint32_t ends = spaceMask & ~previousSpaceMask;
+        // Starts and ends follow each other, so taking them in order of position
+        for (uint32_t borders = starts | ends; borders != 0; borders &= borders - 1) {
+            const size_t border = position + __builtin_ctz(borders);
+            if (insideWord)
+                words.push_back(line.substr(wordStart, border - wordStart));
+            else
+                wordStart = border;
+            insideWord = !insideWord;
+        }
+    }
+#endif
+    // The rest, which is shorter than block, or the whole line without vector instructions
+    for (; position < line.size(); position++) {
+        if (IsSpace(line[position]) == insideWord) {
+            if (insideWord)
+                words.push_back(line.substr(wordStart, position - wordStart));
+            else
+                wordStart = position;
+            insideWord = !insideWord;
+        }
+    }
+
+    if (insideWord)
+        words.push_back(line.substr(wordStart));
+}
+
+vector<string_view> SplitIntoWordsView(string_view line) {
+    vector<string_view> words;
+    SplitIntoWordsView(line, words);
+    return words;
+}
+
+const char* GetTokenizerInstructionSet() {
+    return BLOCK_SIZE == 32 ? "AVX2" : BLOCK_SIZE == 16 ? "SSE2" : "scalar";
+}
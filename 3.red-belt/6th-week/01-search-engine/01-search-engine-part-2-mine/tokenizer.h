@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+using namespace std;
+// Splitting line to words by whitespace, the same way as stream does. Words are views into line, nothing is copied
+void SplitIntoWordsView(string_view line, vector<string_view>& words);
+
+vector<string_view> SplitIntoWordsView(string_view line);
+// Set of instructions, used to search whitespace, it's chosen on compilation
+const char* GetTokenizerInstructionSet();
@@ -0,0 +1,76 @@
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tokenizer.h"
+
+using namespace std;
+using namespace std::chrono;
+// Micro-benchmark of splitting lines to words, built separately: g++ -O2 -march=native tokenizer*.cpp
+// Previous way of splitting - through stream, with copy of every word
+vector<string> SplitIntoWordsByStream(const string& line) {
+    istringstream words_input(line);
+    return {make_move_iterator(istream_iterator<string>(words_input)),
+            make_move_iterator(istream_iterator<string>())};
+}
+
+vector<string> GenerateLines(size_t numberOfLines, size_t wordsPerLine) {
+    mt19937 generator(42);
+    uniform_int_distribution<size_t> wordLength(1, 12);
+    uniform_int_distribution<size_t> numberOfSpaces(1, 3);
+    vector<string> lines(numberOfLines);
+
+    for (auto& line : lines) {
+        line.append(numberOfSpaces(generator) - 1, ' ');
+        for (size_t word = 0; word < wordsPerLine; word++) {
+            const size_t length = wordLength(generator);
+            for (size_t letter = 0; letter < length; letter++)
+                line.push_back(static_cast<char>('a' + generator() % 26));
+            line.append(numberOfSpaces(generator), ' ');
+        }
+    }
+
+    return lines;
+}
+// Running splitting of all lines several times and printing number of words per second
+template <typename Split>
+size_t Measure(const string& name, const vector<string>& lines, Split split) {
+    const size_t numberOfRounds = 5;
+    size_t numberOfWords = 0;
+
+    const auto start = steady_clock::now();
+    for (size_t round = 0; round < numberOfRounds; round++)
+        for (const auto& line : lines)
+            numberOfWords += split(line);
+    const duration<double> elapsed = steady_clock::now() - start;
+
+    cout << name << ": " << static_cast<size_t>(numberOfWords / elapsed.count()) << " tokens/s" << endl;
+    return numberOfWords;
+}
+
+int main() {
+    for (const size_t wordsPerLine : {10, 1000}) {
+        const auto lines = GenerateLines(1'000'000 / wordsPerLine * 10, wordsPerLine);
+        cout << "Lines of " << wordsPerLine << " words, " << GetTokenizerInstructionSet() << " tokenizer" << endl;
+
+        const size_t streamWords = Measure("  istringstream", lines, [](const string& line) {
+            return SplitIntoWordsByStream(line).size();
+        });
+        vector<string_view> words;
+        const size_t viewWords = Measure("  string_view", lines, [&words](const string& line) {
+            SplitIntoWordsView(line, words);
+            return words.size();
+        });
+
+        if (streamWords != viewWords) {
+            cerr << "Tokenizers found different number of words" << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -1,97 +1,659 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <thread>
 #include <unordered_map>
-#include <map>
 #include <mutex>
+#include <vector>
 
 #include "Common.h"
 
 using namespace std;
-// Implementation of a solution
-class LruCache : public ICache {
+// Entry of shard is book in cache or ghost - name and size of recently evicted book without it. Policies use ghosts
+// to notice books, which are evicted too early. Every entry is node of one list of policy, which holds it
+struct CacheEntry {
+    ICache::BookPtr book;
+    size_t size = 0;
+    // Key of entry in hash table, to erase it, when it's released
+    const string* name = nullptr;
+    // Neighbours in list and number of list, zero means, that entry isn't in any list
+    CacheEntry* previous = nullptr;
+    CacheEntry* next = nullptr;
+    int list = 0;
+};
+// Intrusive circular list of entries with sum of their sizes, it's front is the most recent entry
+class EntryList {
 public:
-    LruCache(shared_ptr<IBooksUnpacker> booksUnpacker,
-             const Settings& settings) : booksUnpacker(move(booksUnpacker)) {
-        freeMemory = settings.max_memory;
-        priority = 0;
+    explicit EntryList(int number) : number(number) {
+        head.previous = head.next = &head;
     }
 
-    BookPtr GetBook(const string& bookName) override {
-        m.lock();
-        unordered_node node = nameToBook.extract(bookName);
-        BookPtr result;
+    EntryList(const EntryList&) = delete;
+    EntryList& operator =(const EntryList&) = delete;
+
+    void PushFront(CacheEntry& entry) {
+        entry.previous = &head;
+        entry.next = head.next;
+        head.next->previous = &entry;
+        head.next = &entry;
+        entry.list = number;
+        size += entry.size;
+    }
+
+    void Remove(CacheEntry& entry) {
+        entry.previous->next = entry.next;
+        entry.next->previous = entry.previous;
+        entry.list = 0;
+        size -= entry.size;
+    }
 
-        if (!node.empty())
-            result = getExistingBook(node);
-        else
-            result = getNewBook(bookName);
+    void MoveToFront(CacheEntry& entry) {
+        Remove(entry);
+        PushFront(entry);
+    }
+    // Entries are gone through from back to front, nullptr is returned after the front one
+    [[nodiscard]] CacheEntry* Back() const {
+        return Before(head);
+    }
+
+    [[nodiscard]] CacheEntry* Before(const CacheEntry& entry) const {
+        return entry.previous == &head ? nullptr : entry.previous;
+    }
 
-        return [&]{
-            m.unlock();
-            return result;
-        }();
+    [[nodiscard]] bool Contains(const CacheEntry& entry) const {
+        return entry.list == number;
+    }
+
+    [[nodiscard]] bool IsEmpty() const {
+        return head.next == &head;
+    }
+
+    [[nodiscard]] size_t GetSize() const {
+        return size;
     }
 
 private:
-    shared_ptr<IBooksUnpacker> booksUnpacker;
-    size_t freeMemory;
-    int priority;
-    mutex m = mutex();
+    const int number;
+    CacheEntry head;
+    size_t size = 0;
+};
+// Table of all entries of shard. Nodes of unordered_map never move, so pointers to entries stay valid until they're
+// erased
+class EntryTable {
+public:
+    CacheEntry* Find(const string& name) {
+        const auto it = entries.find(name);
+        return it == end(entries) ? nullptr : &it->second;
+    }
 
-    map<int, string> priorityToBookName;
-    unordered_map<string, pair<int, BookPtr>> nameToBook;
+    CacheEntry& Insert(const string& name) {
+        const auto it = entries.emplace(name, CacheEntry()).first;
+        it->second.name = &it->first;
+        return it->second;
+    }
 
-    using unordered_node = unordered_map<string, pair<int, BookPtr>>::node_type;
+    void Erase(CacheEntry& entry) {
+        entries.erase(entries.find(*entry.name));
+    }
 
-    BookPtr getExistingBook(unordered_node& node) {
-        BookPtr result = node.mapped().second;
+    [[nodiscard]] size_t Size() const {
+        return entries.size();
+    }
 
-        auto mapNode = priorityToBookName.extract(node.mapped().first);
-        mapNode.key() = ++priority;
-        priorityToBookName.insert(move(mapNode));
+private:
+    unordered_map<string, CacheEntry> entries;
+};
+// Policy decides, which books stay in memory of shard, sizes of books in it's lists never sum to more than it.
+// Shard calls policy with it's lock held, and policy erases entries from table itself, when it forgets them
+class IEvictionPolicy {
+public:
+    IEvictionPolicy(EntryTable& table, size_t maxMemory) : table(table), maxMemory(maxMemory) {}
 
-        node.mapped().first = priority;
-        nameToBook.insert(move(node));
+    virtual ~IEvictionPolicy() = default;
+    // Book of entry is requested and found in cache
+    virtual void OnHit(CacheEntry& entry) = 0;
+    // Book is unpacked for new entry or for ghost, policy can keep it or release entry at once
+    virtual void OnMiss(CacheEntry& entry) = 0;
 
-        return result;
+protected:
+    EntryTable& table;
+    const size_t maxMemory;
+    // Book, which doesn't fit the whole memory, is never kept
+    [[nodiscard]] bool fits(const CacheEntry& entry) const {
+        return entry.size <= maxMemory;
+    }
+
+    void release(EntryList& list, CacheEntry& entry) {
+        list.Remove(entry);
+        table.Erase(entry);
+    }
+    // Book of entry is freed, and only it's name is remembered
+    static void makeGhost(EntryList& from, EntryList& to, CacheEntry& entry) {
+        from.Remove(entry);
+        entry.book.reset();
+        to.PushFront(entry);
+    }
+};
+// Books in order of usage, the least recently used one is evicted
+class LruPolicy : public IEvictionPolicy {
+public:
+    using IEvictionPolicy::IEvictionPolicy;
+
+    void OnHit(CacheEntry& entry) override {
+        usage.MoveToFront(entry);
+    }
+
+    void OnMiss(CacheEntry& entry) override {
+        if (!fits(entry))
+            return table.Erase(entry);
+
+        usage.PushFront(entry);
+        while (usage.GetSize() > maxMemory)
+            release(usage, *usage.Back());
+    }
+
+private:
+    EntryList usage{1};
+};
+// 2Q - new book is placed to small queue and it's evicted from there in order of insertion. It's name is remembered,
+// and book, which is requested again after that, goes to main LRU queue, so books, read once, never evict main ones
+class TwoQueuesPolicy : public IEvictionPolicy {
+public:
+    using IEvictionPolicy::IEvictionPolicy;
+
+    void OnHit(CacheEntry& entry) override {
+        if (main.Contains(entry))
+            main.MoveToFront(entry);
+    }
+
+    void OnMiss(CacheEntry& entry) override {
+        const bool wasEvicted = evicted.Contains(entry);
+        if (wasEvicted)
+            evicted.Remove(entry);
+        if (!fits(entry))
+            return table.Erase(entry);
+
+        (wasEvicted ? main : recent).PushFront(entry);
+        while (recent.GetSize() + main.GetSize() > maxMemory) {
+            if (recent.GetSize() > maxMemory / 4 || main.IsEmpty())
+                makeGhost(recent, evicted, *recent.Back());
+            else
+                release(main, *main.Back());
+        }
+        while (evicted.GetSize() > maxMemory / 2)
+            release(evicted, *evicted.Back());
     }
 
-    BookPtr getNewBook(const string& bookName) {
-        BookPtr newBook = booksUnpacker->UnpackBook(bookName);
+private:
+    EntryList recent{1};
+    EntryList main{2};
+    EntryList evicted{3};
+};
+// ARC - books, requested once, and books, requested several times, are in two LRU lists, and ghosts of both of them
+// are remembered. Request of ghost moves target size of the first list to the side, which would keep it
+class ArcPolicy : public IEvictionPolicy {
+public:
+    using IEvictionPolicy::IEvictionPolicy;
+
+    void OnHit(CacheEntry& entry) override {
+        (once.Contains(entry) ? once : several).Remove(entry);
+        several.PushFront(entry);
+    }
+
+    void OnMiss(CacheEntry& entry) override {
+        const bool wasOnce = onceEvicted.Contains(entry), wasSeveral = severalEvicted.Contains(entry);
+        if (wasOnce) {
+            targetOfOnce = min(maxMemory, targetOfOnce + step(entry.size, onceEvicted, severalEvicted));
+            onceEvicted.Remove(entry);
+        }
+        if (wasSeveral) {
+            targetOfOnce -= min(targetOfOnce, step(entry.size, severalEvicted, onceEvicted));
+            severalEvicted.Remove(entry);
+        }
+        if (!fits(entry))
+            return table.Erase(entry);
+
+        while (once.GetSize() + several.GetSize() + entry.size > maxMemory) {
+            if (!once.IsEmpty() && (once.GetSize() > targetOfOnce || several.IsEmpty() ||
+                                    (wasSeveral && once.GetSize() == targetOfOnce)))
+                makeGhost(once, onceEvicted, *once.Back());
+            else
+                makeGhost(several, severalEvicted, *several.Back());
+        }
+        (wasOnce || wasSeveral ? several : once).PushFront(entry);
+        // Ghosts of the first list together with it take at most all memory, and all lists take at most twice more
+        while (once.GetSize() + onceEvicted.GetSize() > maxMemory && !onceEvicted.IsEmpty())
+            release(onceEvicted, *onceEvicted.Back());
+        while (once.GetSize() + several.GetSize() + onceEvicted.GetSize() + severalEvicted.GetSize() > 2 * maxMemory &&
+               !severalEvicted.IsEmpty())
+            release(severalEvicted, *severalEvicted.Back());
+    }
 
-        const size_t wantedMemory = newBook->GetContent().size();
+private:
+    EntryList once{1};
+    EntryList several{2};
+    EntryList onceEvicted{3};
+    EntryList severalEvicted{4};
+    // Target size of the first list
+    size_t targetOfOnce = 0;
+    // Target is moved by size of book, multiplied by ratio of sizes of ghost lists, if the other one is bigger
+    static size_t step(size_t size, const EntryList& requested, const EntryList& other) {
+        if (requested.GetSize() == 0 || other.GetSize() <= requested.GetSize())
+            return size;
+        return size * (other.GetSize() / requested.GetSize());
+    }
+};
+// Count-min sketch - approximate numbers of requests of all books in small memory. Every book has counter in every
+// row, and it's frequency is the smallest of them. Counters are halved periodically, so old requests are forgotten
+class FrequencySketch {
+public:
+    // Sketch grows with number of books, counted before are forgotten then
+    void Reserve(size_t numberOfBooks) {
+        if (numberOfBooks <= width)
+            return;
+
+        while (width < numberOfBooks)
+            width *= 2;
+        counters.assign(width * NUMBER_OF_ROWS, 0);
+        numberOfAdditions = 0;
+    }
+
+    void Increment(size_t hash) {
+        for (size_t row = 0; row < NUMBER_OF_ROWS; row++)
+            if (auto& counter = counters[row * width + index(hash, row)]; counter < MAX_FREQUENCY)
+                counter++;
+
+        if (++numberOfAdditions == width * SAMPLE_FACTOR) {
+            for (auto& counter : counters)
+                counter /= 2;
+            numberOfAdditions /= 2;
+        }
+    }
+
+    [[nodiscard]] uint8_t Estimate(size_t hash) const {
+        uint8_t frequency = MAX_FREQUENCY;
+        for (size_t row = 0; row < NUMBER_OF_ROWS; row++)
+            frequency = min(frequency, counters[row * width + index(hash, row)]);
+        return frequency;
+    }
+
+private:
+    constexpr const static size_t NUMBER_OF_ROWS = 4;
+    constexpr const static uint8_t MAX_FREQUENCY = 15;
+    constexpr const static size_t SAMPLE_FACTOR = 10;
+
+    size_t width = 64;
+    vector<uint8_t> counters = vector<uint8_t>(width * NUMBER_OF_ROWS);
+    size_t numberOfAdditions = 0;
+    // Every row takes it's own mix of bits of hash, width is power of two
+    [[nodiscard]] size_t index(size_t hash, size_t row) const {
+        const uint64_t mixed = (hash + row * 0x9E3779B97F4A7C15ull) * 0xBF58476D1CE4E5B9ull;
+        return (mixed ^ mixed >> 31) & (width - 1);
+    }
+};
+// W-TinyLFU - new book goes to small LRU window, and book, evicted from it, is admitted to main part only, if it was
+// requested more often, than books, it would evict. Main part is segmented LRU: books, requested there again, are
+// protected, and only the rest of them are evicted
+class WTinyLfuPolicy : public IEvictionPolicy {
+public:
+    using IEvictionPolicy::IEvictionPolicy;
 
-        if (freeMemory >= wantedMemory)
-            insertNewBook(newBook, wantedMemory);
-        else
-        if (freeCacheMemory(wantedMemory))
-            insertNewBook(newBook, wantedMemory);
+    void OnHit(CacheEntry& entry) override {
+        frequencies.Increment(hash<string>{}(*entry.name));
+        if (window.Contains(entry))
+            return window.MoveToFront(entry);
+        if (protectedPart.Contains(entry))
+            return protectedPart.MoveToFront(entry);
 
-        return newBook;
+        probation.Remove(entry);
+        protectedPart.PushFront(entry);
+        while (protectedPart.GetSize() > (maxMemory - getMemoryOfWindow()) * 4 / 5) {
+            CacheEntry& demoted = *protectedPart.Back();
+            protectedPart.Remove(demoted);
+            probation.PushFront(demoted);
+        }
     }
 
-    void insertNewBook(const BookPtr& newBook, size_t wantedMemory) {
-        freeMemory -= wantedMemory;
-        priorityToBookName.insert({++priority, newBook->GetName() });
-        nameToBook.insert({newBook->GetName(), make_pair(priority, newBook)});
+    void OnMiss(CacheEntry& entry) override {
+        frequencies.Reserve(table.Size());
+        frequencies.Increment(hash<string>{}(*entry.name));
+        if (!fits(entry))
+            return table.Erase(entry);
+        // Window takes memory of main part, if it's full
+        window.PushFront(entry);
+        while (window.GetSize() > getMemoryOfWindow() || getUsedMemory() > maxMemory) {
+            if (window.GetSize() > getMemoryOfWindow() || (probation.IsEmpty() && protectedPart.IsEmpty())) {
+                CacheEntry& candidate = *window.Back();
+                window.Remove(candidate);
+                admit(candidate);
+            } else {
+                auto& list = probation.IsEmpty() ? protectedPart : probation;
+                release(list, *list.Back());
+            }
+        }
     }
 
-    bool freeCacheMemory(size_t wantedMemory) {
-        while (!priorityToBookName.empty()) {
-            const auto begin = priorityToBookName.begin();
+private:
+    EntryList window{1};
+    EntryList probation{2};
+    EntryList protectedPart{3};
+    FrequencySketch frequencies;
 
-            const auto finder =  nameToBook.find(begin->second);
-            freeMemory += finder->second.second->GetContent().size();
+    [[nodiscard]] size_t getMemoryOfWindow() const {
+        return maxMemory / 100;
+    }
 
-            nameToBook.erase(finder);
-            priorityToBookName.erase(begin);
+    [[nodiscard]] size_t getUsedMemory() const {
+        return window.GetSize() + probation.GetSize() + protectedPart.GetSize();
+    }
+    // Victims are taken from the back of probation and then of protected part, until candidate fits, and all of them
+    // should be requested more rarely, than it
+    void admit(CacheEntry& candidate) {
+        const uint8_t frequency = frequencies.Estimate(hash<string>{}(*candidate.name));
+        size_t freedMemory = 0;
+        for (auto* list : {&probation, &protectedPart})
+            for (auto* victim = list->Back(); victim != nullptr; victim = list->Before(*victim)) {
+                if (getUsedMemory() + candidate.size <= maxMemory + freedMemory)
+                    break;
+                if (frequencies.Estimate(hash<string>{}(*victim->name)) >= frequency)
+                    return table.Erase(candidate);
+                freedMemory += victim->size;
+            }
+        if (getUsedMemory() + candidate.size > maxMemory + freedMemory)
+            return table.Erase(candidate);
 
-            if (freeMemory >= wantedMemory)
+        while (getUsedMemory() + candidate.size > maxMemory) {
+            auto& list = probation.IsEmpty() ? protectedPart : probation;
+            release(list, *list.Back());
+        }
+        probation.PushFront(candidate);
+    }
+};
+// Part of cache with it's own lock, memory and policy. Book is unpacked without lock, and only once for all threads,
+// which miss it at the same time
+class CacheShard {
+public:
+    void Configure(size_t maxMemory, ICache::EvictionPolicy evictionPolicy) {
+        this->maxMemory = maxMemory;
+        switch (evictionPolicy) {
+            case ICache::EvictionPolicy::Lru:
+                policy = make_unique<LruPolicy>(table, maxMemory);
+                break;
+            case ICache::EvictionPolicy::TwoQueues:
+                policy = make_unique<TwoQueuesPolicy>(table, maxMemory);
                 break;
+            case ICache::EvictionPolicy::Arc:
+                policy = make_unique<ArcPolicy>(table, maxMemory);
+                break;
+            case ICache::EvictionPolicy::WTinyLfu:
+                policy = make_unique<WTinyLfuPolicy>(table, maxMemory);
+                break;
+        }
+    }
+    // Books, which don't fit this shard, are kept in bigBooks, if it's given. Lock of bigBooks is taken only under
+    // lock of this shard, so they never wait for each other in different order
+    ICache::BookPtr GetBook(const string& bookName, IBooksUnpacker& booksUnpacker, CacheShard* bigBooks = nullptr) {
+        unique_lock lock(m);
+        if (auto book = find(bookName); book || (bigBooks != nullptr && (book = bigBooks->Find(bookName)))) {
+            statistics.hits++;
+            return book;
+        }
+        // Another thread unpacks this book already, so it's result is waited for
+        if (auto it = unpacking.find(bookName); it != end(unpacking)) {
+            statistics.saved_unpacks++;
+            const auto book = it->second;
+            lock.unlock();
+            return book.get();
+        }
+
+        statistics.unpacks++;
+        promise<ICache::BookPtr> newBook;
+        unpacking.emplace(bookName, newBook.get_future().share());
+        lock.unlock();
+        try {
+            ICache::BookPtr book = booksUnpacker.UnpackBook(bookName);
+            // Book is inserted and stops being unpacked at once, so other threads find it in one of places. Policy
+            // can still remember it's ghost
+            lock.lock();
+            unpacking.erase(bookName);
+            if (bigBooks != nullptr && book->GetContent().size() > maxMemory)
+                bigBooks->Insert(bookName, book);
+            else
+                insert(bookName, book);
+            lock.unlock();
+            newBook.set_value(book);
+            return book;
+        } catch (...) {
+            if (!lock.owns_lock())
+                lock.lock();
+            unpacking.erase(bookName);
+            lock.unlock();
+            newBook.set_exception(current_exception());
+            throw;
+        }
+    }
+
+    ICache::BookPtr Find(const string& bookName) {
+        lock_guard guard(m);
+        return find(bookName);
+    }
+
+    void Insert(const string& bookName, ICache::BookPtr book) {
+        lock_guard guard(m);
+        insert(bookName, move(book));
+    }
+
+    ICache::Statistics GetStatistics() const {
+        lock_guard guard(m);
+        return statistics;
+    }
+
+private:
+    mutable mutex m = mutex();
+    size_t maxMemory = 0;
+    EntryTable table;
+    unique_ptr<IEvictionPolicy> policy;
+    // Books, which are unpacked now, and their results for threads, which wait for them
+    unordered_map<string, shared_future<ICache::BookPtr>> unpacking;
+    ICache::Statistics statistics;
+
+    ICache::BookPtr find(const string& bookName) {
+        auto* entry = table.Find(bookName);
+        if (entry == nullptr || !entry->book)
+            return nullptr;
+        policy->OnHit(*entry);
+        return entry->book;
+    }
+
+    void insert(const string& bookName, ICache::BookPtr book) {
+        auto* entry = table.Find(bookName);
+        if (entry == nullptr)
+            entry = &table.Insert(bookName);
+        entry->size = book->GetContent().size();
+        entry->book = move(book);
+        policy->OnMiss(*entry);
+    }
+};
+// Workers of GetBookAsync and Prefetch with bounded queue of their requests. Reader, who asks for more books, than
+// queue holds, waits for place in it, while prefetch is only a hint and skips books instead
+class BackgroundPool {
+public:
+    BackgroundPool(size_t numberOfThreads, size_t queueCapacity) : queueCapacity(max<size_t>(1, queueCapacity)) {
+        for (size_t worker = 0; worker < max<size_t>(1, numberOfThreads); worker++)
+            workers.emplace_back(&BackgroundPool::work, this);
+    }
+
+    BackgroundPool(const BackgroundPool&) = delete;
+    BackgroundPool& operator =(const BackgroundPool&) = delete;
+    // Requests in queue are done before workers stop, so every caller gets it's book
+    ~BackgroundPool() {
+        {
+            lock_guard guard(m);
+            stopping = true;
+        }
+        changed.notify_all();
+
+        for (auto& worker : workers)
+            worker.join();
+    }
+    // Returns false, if queue is full and caller doesn't wait
+    bool Push(function<void()> request, bool wait) {
+        unique_lock lock(m);
+        if (wait)
+            changed.wait(lock, [this] { return requests.size() < queueCapacity; });
+        else if (requests.size() >= queueCapacity)
+            return false;
+        requests.push_back(move(request));
+        lock.unlock();
+        changed.notify_all();
+
+        return true;
+    }
+
+private:
+    const size_t queueCapacity;
+    mutex m;
+    // Request is pushed or taken, or pool stops
+    condition_variable changed;
+    deque<function<void()>> requests;
+    bool stopping = false;
+    vector<thread> workers;
+
+    void work() {
+        unique_lock lock(m);
+        while (true) {
+            changed.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (requests.empty())
+                return;
+
+            auto request = move(requests.front());
+            requests.pop_front();
+            lock.unlock();
+            changed.notify_all();
+            request();
+            lock.lock();
         }
+    }
+};
+// Implementation of a solution. Books are divided to shards by hash of name, so threads, reading different books,
+// don't wait for each other. Books, which don't fit their shard, are kept in one more shard for big books, it takes
+// a quarter of max_memory, when there are several shards. Memory of shards sums to max_memory
+class ShardedCache : public ICache {
+public:
+    ShardedCache(shared_ptr<IBooksUnpacker> booksUnpacker, const Settings& settings)
+            : booksUnpacker(move(booksUnpacker)), maxMemory(settings.max_memory),
+              numberOfBackgroundThreads(settings.background_threads),
+              backgroundQueueCapacity(settings.background_queue_capacity), shards(chooseNumberOfShards(settings)) {
+        const size_t memoryOfBigBooks = shards.size() > 1 ? settings.max_memory / 4 : 0;
+        const size_t memoryOfShards = settings.max_memory - memoryOfBigBooks;
+        bigBooks.Configure(memoryOfBigBooks, settings.eviction_policy);
+        // Remainder of division is given to the first shards
+        for (size_t shard = 0; shard < shards.size(); shard++)
+            shards[shard].Configure(memoryOfShards / shards.size() + (shard < memoryOfShards % shards.size()),
+                                    settings.eviction_policy);
+    }
+
+    BookPtr GetBook(const string& bookName) override {
+        return shards[hash<string>{}(bookName) % shards.size()].GetBook(bookName, *booksUnpacker,
+                                                                        shards.size() > 1 ? &bigBooks : nullptr);
+    }
+    // If queue of background workers is full, caller waits for place in it
+    future<BookPtr> GetBookAsync(const string& bookName) override {
+        // Function of queue is copied, so it holds task by pointer
+        auto request = make_shared<packaged_task<BookPtr()>>([this, bookName] {
+            return GetBook(bookName);
+        });
+        auto result = request->get_future();
+        getPool().Push([request] { (*request)(); }, true);
+
+        return result;
+    }
+    // Prefetch is only a hint: books, which don't fit queue of workers, are skipped, and books of one call take at
+    // most half of max_memory, so they don't evict all books, which are read now
+    future<void> Prefetch(const vector<string>& bookNames) override {
+        // One more request finishes, when all of them are submitted
+        auto batch = make_shared<PrefetchBatch>();
+        batch->numberOfRequests = bookNames.size() + 1;
+        auto result = batch->done.get_future();
+
+        for (const auto& bookName : bookNames)
+            if (maxMemory == 0 || !getPool().Push([this, batch, bookName] {
+                prefetch(*batch, bookName);
+            }, false))
+                finishPrefetch(*batch);
+        finishPrefetch(*batch);
+
+        return result;
+    }
+
+    [[nodiscard]] Statistics GetStatistics() const override {
+        Statistics result;
+        for (const auto& shard : shards) {
+            const auto statistics = shard.GetStatistics();
+            result.hits += statistics.hits;
+            result.unpacks += statistics.unpacks;
+            result.saved_unpacks += statistics.saved_unpacks;
+        }
+
+        return result;
+    }
+
+private:
+    // Shard is small part of memory, so there are only so many of them, that every one holds several books
+    constexpr const static size_t MIN_MEMORY_OF_SHARD = 1 << 20;
+    constexpr const static size_t MAX_NUMBER_OF_SHARDS = 64;
+    // Every shard has it's own line of cache, so locks of neighbours don't slow each other
+    struct alignas(64) AlignedShard : CacheShard {};
+
+    struct PrefetchBatch {
+        atomic<size_t> memory = 0;
+        atomic<size_t> numberOfRequests = 0;
+        promise<void> done;
+    };
+
+    shared_ptr<IBooksUnpacker> booksUnpacker;
+    const size_t maxMemory;
+    const size_t numberOfBackgroundThreads;
+    const size_t backgroundQueueCapacity;
+    vector<AlignedShard> shards;
+    AlignedShard bigBooks;
+    // Workers are started with the first background request, and they're stopped before shards are destroyed
+    once_flag poolIsStarted;
+    unique_ptr<BackgroundPool> pool;
+
+    BackgroundPool& getPool() {
+        call_once(poolIsStarted, [this] {
+            pool = make_unique<BackgroundPool>(numberOfBackgroundThreads, backgroundQueueCapacity);
+        });
+        return *pool;
+    }
+    // Errors of unpacking aren't important for prefetch, book is unpacked again, when it's read
+    void prefetch(PrefetchBatch& batch, const string& bookName) {
+        if (batch.memory < maxMemory / 2) {
+            try {
+                batch.memory += GetBook(bookName)->GetContent().size();
+            } catch (...) {}
+        }
+        finishPrefetch(batch);
+    }
+
+    static void finishPrefetch(PrefetchBatch& batch) {
+        if (--batch.numberOfRequests == 0)
+            batch.done.set_value();
+    }
 
-        return freeMemory >= wantedMemory;
+    static size_t chooseNumberOfShards(const Settings& settings) {
+        if (settings.number_of_shards != 0)
+            return settings.number_of_shards;
+        return clamp<size_t>(settings.max_memory / MIN_MEMORY_OF_SHARD, 1, MAX_NUMBER_OF_SHARDS);
     }
 };
 
 unique_ptr<ICache> MakeCache(shared_ptr<IBooksUnpacker> booksUnpacker, const ICache::Settings& settings) {
-    return make_unique<LruCache>(move(booksUnpacker), settings);
+    return make_unique<ShardedCache>(move(booksUnpacker), settings);
 }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <future>
 #include <memory>
 #include <string>
+#include <vector>
 // Interface for our solution
 class IBook {
 public:
@@ -21,16 +23,52 @@ public:
 
 class ICache {
 public:
+    // LRU is flushed by scan of many books, which are read once, the other policies keep books, read several times
+    enum class EvictionPolicy {
+        Lru,
+        TwoQueues,
+        Arc,
+        WTinyLfu
+    };
+
     struct Settings {
         size_t max_memory = 0;
+        // Zero means, that cache chooses number of shards by max_memory. Books, which don't fit part of their shard,
+        // share a quarter of max_memory, so with several shards book is cached, while it fits max_memory / 4
+        size_t number_of_shards = 0;
+        EvictionPolicy eviction_policy = EvictionPolicy::Lru;
+        // Workers of GetBookAsync and Prefetch, and the longest queue of their requests
+        size_t background_threads = 2;
+        size_t background_queue_capacity = 64;
     };
 
     using BookPtr = std::shared_ptr<const IBook>;
+    // Every request is a hit, an unpack, or a saved unpack, when book is already unpacked by another thread
+    struct Statistics {
+        size_t hits = 0;
+        size_t unpacks = 0;
+        size_t saved_unpacks = 0;
+    };
 
 public:
     virtual ~ICache() = default;
 
     virtual BookPtr GetBook(const std::string& book_name) = 0;
+
+    // Book is got by background worker, so caller doesn't wait for unpacking
+    virtual std::future<BookPtr> GetBookAsync(const std::string& book_name) {
+        return std::async(std::launch::deferred, [this, book_name] { return GetBook(book_name); });
+    }
+    // Books, which will be read soon, are unpacked to cache in background, future is ready, when they're there
+    virtual std::future<void> Prefetch(const std::vector<std::string>& /*book_names*/) {
+        std::promise<void> done;
+        done.set_value();
+        return done.get_future();
+    }
+
+    [[nodiscard]] virtual Statistics GetStatistics() const {
+        return {};
+    }
 };
 
 std::unique_ptr<ICache> MakeCache(
@@ -0,0 +1,176 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+
+using namespace std;
+using namespace std::chrono;
+// Benchmark of cache for different numbers of books, built without tests, with one of solutions:
+// g++ -std=c++17 -O2 -pthread cache_benchmark.cpp 02-cache-mine.cpp
+// Numbers of books are given like --books=1000,100000, for every one of them phases warm_up, hits and evictions
+// are printed as lines of JSON with time of one lookup
+struct BenchmarkSettings {
+    size_t seed = 42;
+    vector<size_t> numbersOfBooks = {1'000, 10'000, 100'000, 1'000'000, 10'000'000};
+    size_t numberOfLookups = 1'000'000;
+};
+// Content of every book has the same size, so half of memory of all books is always half of them
+class BenchmarkBook : public IBook {
+public:
+    BenchmarkBook(string name, string content) : name(move(name)), content(move(content)) {}
+
+    [[nodiscard]] const string& GetName() const override {
+        return name;
+    }
+
+    [[nodiscard]] const string& GetContent() const override {
+        return content;
+    }
+
+private:
+    string name;
+    string content;
+};
+
+class BenchmarkUnpacker : public IBooksUnpacker {
+public:
+    constexpr const static size_t SIZE_OF_BOOK = 8;
+
+    unique_ptr<IBook> UnpackBook(const string& bookName) override {
+        ++numberOfUnpacks;
+        return make_unique<BenchmarkBook>(bookName, string(SIZE_OF_BOOK, 'x'));
+    }
+
+    [[nodiscard]] size_t GetNumberOfUnpacks() const {
+        return numberOfUnpacks;
+    }
+
+private:
+    atomic<size_t> numberOfUnpacks = 0;
+};
+
+vector<size_t> ParseList(const string& text) {
+    vector<size_t> values;
+    for (size_t begin = 0; begin < text.size();) {
+        const size_t comma = min(text.find(',', begin), text.size());
+        values.push_back(stoul(text.substr(begin, comma - begin)));
+        begin = comma + 1;
+    }
+
+    return values;
+}
+
+BenchmarkSettings ParseArguments(int argc, char* argv[]) {
+    BenchmarkSettings settings;
+    for (int argument = 1; argument < argc; argument++) {
+        const string text = argv[argument];
+        const size_t equalSign = text.find('=');
+        if (text.substr(0, 2) != "--" || equalSign == string::npos)
+            throw invalid_argument("Option should look like --name=value, got " + text);
+        const string name = text.substr(2, equalSign - 2);
+        const string value = text.substr(equalSign + 1);
+
+        if (name == "seed")
+            settings.seed = stoul(value);
+        else if (name == "books")
+            settings.numbersOfBooks = ParseList(value);
+        else if (name == "lookups")
+            settings.numberOfLookups = stoul(value);
+        else
+            throw invalid_argument("Unknown option " + name);
+    }
+
+    return settings;
+}
+
+double ToSeconds(steady_clock::duration duration) {
+    return duration_cast<microseconds>(duration).count() / 1e6;
+}
+
+template <typename Function>
+steady_clock::duration Measure(Function function) {
+    const auto start = steady_clock::now();
+    function();
+    return steady_clock::now() - start;
+}
+// Random lookups of books, every one of them is taken with the same probability
+steady_clock::duration MeasureLookups(ICache& cache, const vector<string>& names, const BenchmarkSettings& settings) {
+    mt19937_64 generator(settings.seed);
+    uniform_int_distribution<size_t> distribution(0, names.size() - 1);
+    vector<size_t> order(settings.numberOfLookups);
+    for (auto& book : order)
+        book = distribution(generator);
+
+    size_t checksum = 0;
+    const auto elapsed = Measure([&cache, &names, &order, &checksum] {
+        for (const size_t book : order)
+            checksum += cache.GetBook(names[book])->GetContent().size();
+    });
+    if (checksum != order.size() * BenchmarkUnpacker::SIZE_OF_BOOK)
+        throw logic_error("Cache returned wrong book");
+
+    return elapsed;
+}
+
+void PrintLookups(const string& phase, size_t numberOfBooks, size_t numberOfLookups, size_t numberOfMisses,
+                  steady_clock::duration elapsed) {
+    const double seconds = ToSeconds(elapsed);
+    cout << "{\"phase\": \"" << phase << "\", "
+         << "\"books\": " << numberOfBooks << ", "
+         << "\"lookups\": " << numberOfLookups << ", "
+         << "\"hit_ratio\": " << 1 - static_cast<double>(numberOfMisses) / numberOfLookups << ", "
+         << "\"seconds\": " << seconds << ", "
+         << "\"lookups_per_second\": " << (seconds > 0 ? numberOfLookups / seconds : 0) << ", "
+         << "\"ns_per_lookup\": " << seconds * 1e9 / numberOfLookups << "}" << endl;
+}
+// For every number of books there are two phases: hits, when cache holds all books, and evictions, when it holds
+// only half of them, so about every second lookup unpacks book and evicts another one
+void RunBenchmark(size_t numberOfBooks, const BenchmarkSettings& settings) {
+    vector<string> names(numberOfBooks);
+    for (size_t book = 0; book < numberOfBooks; book++)
+        names[book] = "book" + to_string(book);
+
+    {
+        auto unpacker = make_shared<BenchmarkUnpacker>();
+        auto cache = MakeCache(unpacker, {numberOfBooks * BenchmarkUnpacker::SIZE_OF_BOOK});
+        const auto warmUp = Measure([&cache, &names] {
+            for (const auto& name : names)
+                cache->GetBook(name);
+        });
+        PrintLookups("warm_up", numberOfBooks, numberOfBooks, numberOfBooks, warmUp);
+
+        const auto hits = MeasureLookups(*cache, names, settings);
+        PrintLookups("hits", numberOfBooks, settings.numberOfLookups,
+                     unpacker->GetNumberOfUnpacks() - numberOfBooks, hits);
+    }
+
+    auto unpacker = make_shared<BenchmarkUnpacker>();
+    auto cache = MakeCache(unpacker, {numberOfBooks / 2 * BenchmarkUnpacker::SIZE_OF_BOOK});
+    for (size_t book = 0; book < numberOfBooks / 2; book++)
+        cache->GetBook(names[book]);
+    const size_t unpacksBefore = unpacker->GetNumberOfUnpacks();
+    const auto evictions = MeasureLookups(*cache, names, settings);
+    PrintLookups("evictions", numberOfBooks, settings.numberOfLookups,
+                 unpacker->GetNumberOfUnpacks() - unpacksBefore, evictions);
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkSettings settings;
+    try {
+        settings = ParseArguments(argc, argv);
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+
+    for (const size_t numberOfBooks : settings.numbersOfBooks)
+        if (numberOfBooks != 0)
+            RunBenchmark(numberOfBooks, settings);
+
+    return 0;
+}
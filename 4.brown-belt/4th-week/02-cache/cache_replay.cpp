@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Common.h"
+
+using namespace std;
+using namespace std::chrono;
+// Replay of log of requests with every eviction policy, built without tests with solution, which has policies:
+// g++ -std=c++17 -O2 -pthread cache_replay.cpp 02-cache-mine.cpp
+// Log has one request per line - name of book and optionally it's size after tab. Without log, requests are generated:
+// books are taken by Zipf distribution, and every scan_every requests there is a scan of new books, read once.
+// Log is given by --trace=file, policies like --policies=lru,arc, and hit ratio of every one of them is printed as
+// line of JSON
+struct ReplaySettings {
+    string trace;
+    // Generated requests are written here, to be replayed later
+    string saveTrace;
+    size_t seed = 42;
+    size_t numberOfBooks = 100'000;
+    size_t numberOfRequests = 1'000'000;
+    double skew = 0.9;
+    size_t scanEvery = 50'000;
+    size_t scanLength = 20'000;
+    // Size of book without size in log
+    size_t sizeOfBook = 1024;
+    // Zero means tenth part of sizes of all books
+    size_t maxMemory = 0;
+    size_t numberOfShards = 1;
+    vector<ICache::EvictionPolicy> policies = {ICache::EvictionPolicy::Lru, ICache::EvictionPolicy::TwoQueues,
+                                               ICache::EvictionPolicy::Arc, ICache::EvictionPolicy::WTinyLfu};
+};
+
+struct Trace {
+    vector<string> requests;
+    unordered_map<string, size_t> sizes;
+};
+
+const char* GetPolicyName(ICache::EvictionPolicy policy) {
+    switch (policy) {
+        case ICache::EvictionPolicy::Lru:
+            return "lru";
+        case ICache::EvictionPolicy::TwoQueues:
+            return "2q";
+        case ICache::EvictionPolicy::Arc:
+            return "arc";
+        case ICache::EvictionPolicy::WTinyLfu:
+            return "w-tinylfu";
+    }
+
+    return "unknown";
+}
+
+vector<ICache::EvictionPolicy> ParsePolicies(const string& text) {
+    vector<ICache::EvictionPolicy> policies;
+    for (size_t begin = 0; begin < text.size();) {
+        const size_t comma = min(text.find(',', begin), text.size());
+        const string name = text.substr(begin, comma - begin);
+        begin = comma + 1;
+
+        if (name == "lru")
+            policies.push_back(ICache::EvictionPolicy::Lru);
+        else if (name == "2q")
+            policies.push_back(ICache::EvictionPolicy::TwoQueues);
+        else if (name == "arc")
+            policies.push_back(ICache::EvictionPolicy::Arc);
+        else if (name == "w-tinylfu")
+            policies.push_back(ICache::EvictionPolicy::WTinyLfu);
+        else
+            throw invalid_argument("Unknown policy " + name);
+    }
+
+    return policies;
+}
+
+ReplaySettings ParseArguments(int argc, char* argv[]) {
+    ReplaySettings settings;
+    for (int argument = 1; argument < argc; argument++) {
+        const string text = argv[argument];
+        const size_t equalSign = text.find('=');
+        if (text.substr(0, 2) != "--" || equalSign == string::npos)
+            throw invalid_argument("Option should look like --name=value, got " + text);
+        const string name = text.substr(2, equalSign - 2);
+        const string value = text.substr(equalSign + 1);
+
+        if (name == "trace")
+            settings.trace = value;
+        else if (name == "save-trace")
+            settings.saveTrace = value;
+        else if (name == "seed")
+            settings.seed = stoul(value);
+        else if (name == "books")
+            settings.numberOfBooks = stoul(value);
+        else if (name == "requests")
+            settings.numberOfRequests = stoul(value);
+        else if (name == "skew")
+            settings.skew = stod(value);
+        else if (name == "scan-every")
+            settings.scanEvery = stoul(value);
+        else if (name == "scan-length")
+            settings.scanLength = stoul(value);
+        else if (name == "book-size")
+            settings.sizeOfBook = stoul(value);
+        else if (name == "memory")
+            settings.maxMemory = stoul(value);
+        else if (name == "shards")
+            settings.numberOfShards = stoul(value);
+        else if (name == "policies")
+            settings.policies = ParsePolicies(value);
+        else
+            throw invalid_argument("Unknown option " + name);
+    }
+    if (settings.numberOfBooks == 0)
+        throw invalid_argument("Number of books can't be zero");
+
+    return settings;
+}
+
+Trace ReadTrace(const ReplaySettings& settings) {
+    ifstream input(settings.trace);
+    if (!input)
+        throw runtime_error("Can't open " + settings.trace);
+
+    Trace trace;
+    for (string line; getline(input, line);) {
+        const size_t tab = line.find('\t');
+        const string name = line.substr(0, tab);
+        if (name.empty())
+            continue;
+        trace.sizes[name] = tab == string::npos ? settings.sizeOfBook : stoul(line.substr(tab + 1));
+        trace.requests.push_back(name);
+    }
+
+    return trace;
+}
+
+Trace GenerateTrace(const ReplaySettings& settings) {
+    mt19937_64 generator(settings.seed);
+    vector<double> cumulative(settings.numberOfBooks);
+    double sum = 0;
+    for (size_t rank = 0; rank < settings.numberOfBooks; rank++)
+        cumulative[rank] = sum += 1 / pow(static_cast<double>(rank + 1), settings.skew);
+    uniform_real_distribution<double> distribution(0, sum);
+
+    Trace trace;
+    size_t numberOfScannedBooks = 0;
+    while (trace.requests.size() < settings.numberOfRequests) {
+        if (settings.scanEvery != 0 && trace.requests.size() % settings.scanEvery == settings.scanEvery - 1) {
+            for (size_t book = 0; book < settings.scanLength; book++)
+                trace.requests.push_back("scan-" + to_string(numberOfScannedBooks++));
+        }
+        const auto position = upper_bound(begin(cumulative), end(cumulative), distribution(generator));
+        trace.requests.push_back("book-" + to_string(min<size_t>(position - begin(cumulative), cumulative.size() - 1)));
+    }
+    for (const auto& name : trace.requests)
+        trace.sizes[name] = settings.sizeOfBook;
+
+    return trace;
+}
+// Book has size, written in log, content of it is unimportant
+class ReplayBook : public IBook {
+public:
+    ReplayBook(string name, size_t size) : name(move(name)), content(size, 'x') {}
+
+    [[nodiscard]] const string& GetName() const override {
+        return name;
+    }
+
+    [[nodiscard]] const string& GetContent() const override {
+        return content;
+    }
+
+private:
+    string name;
+    string content;
+};
+
+class ReplayUnpacker : public IBooksUnpacker {
+public:
+    explicit ReplayUnpacker(const unordered_map<string, size_t>& sizes) : sizes(sizes) {}
+
+    unique_ptr<IBook> UnpackBook(const string& bookName) override {
+        return make_unique<ReplayBook>(bookName, sizes.at(bookName));
+    }
+
+private:
+    const unordered_map<string, size_t>& sizes;
+};
+
+int main(int argc, char* argv[]) {
+    ReplaySettings settings;
+    Trace trace;
+    try {
+        settings = ParseArguments(argc, argv);
+        trace = settings.trace.empty() ? GenerateTrace(settings) : ReadTrace(settings);
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+
+    if (!settings.saveTrace.empty()) {
+        ofstream output(settings.saveTrace);
+        for (const auto& name : trace.requests)
+            output << name << '\t' << trace.sizes[name] << '\n';
+    }
+
+    size_t sizeOfAllBooks = 0;
+    for (const auto& [name, size] : trace.sizes)
+        sizeOfAllBooks += size;
+    const size_t maxMemory = settings.maxMemory != 0 ? settings.maxMemory : sizeOfAllBooks / 10;
+
+    for (const auto policy : settings.policies) {
+        ICache::Settings cacheSettings;
+        cacheSettings.max_memory = maxMemory;
+        cacheSettings.number_of_shards = settings.numberOfShards;
+        cacheSettings.eviction_policy = policy;
+        auto cache = MakeCache(make_shared<ReplayUnpacker>(trace.sizes), cacheSettings);
+
+        const auto start = steady_clock::now();
+        for (const auto& name : trace.requests)
+            cache->GetBook(name);
+        const duration<double> elapsed = steady_clock::now() - start;
+
+        const auto statistics = cache->GetStatistics();
+        cout << "{\"phase\": \"replay\", "
+             << "\"policy\": \"" << GetPolicyName(policy) << "\", "
+             << "\"requests\": " << trace.requests.size() << ", "
+             << "\"books\": " << trace.sizes.size() << ", "
+             << "\"memory\": " << maxMemory << ", "
+             << "\"hit_ratio\": " << static_cast<double>(statistics.hits) / max<size_t>(trace.requests.size(), 1)
+             << ", "
+             << "\"unpacks\": " << statistics.unpacks << ", "
+             << "\"seconds\": " << elapsed.count() << ", "
+             << "\"requests_per_second\": " << trace.requests.size() / max(elapsed.count(), 1e-9) << "}" << endl;
+    }
+
+    return 0;
+}
@@ -1,13 +1,18 @@
 #include <atomic>
+#include <chrono>
 #include <future>
 #include <random>
+#include <iomanip>
 #include <sstream>
+#include <thread>
 
 #include "Common.h"
 #include "test_runner.h"
 
 using namespace std;
-// This file, again, provides only environment and tests, while solution is placed in another file
+// This file, again, provides only environment and tests, while solution is placed in another file. Tests of
+// extensions of interface, which only 02-cache-mine.cpp implements, are built with -DCACHE_TEST_EXTENSIONS:
+// g++ -std=c++17 -pthread -I../.. -DCACHE_TEST_EXTENSIONS main.cpp 02-cache-mine.cpp
 class Book : public IBook {
 public:
     Book(
@@ -64,6 +69,15 @@ private:
     atomic<int> unpacked_books_count_ = 0;
 };
 
+// Unpacking takes time, so threads, which want the same book, miss it at the same time
+class SlowBooksUnpacker : public BooksUnpacker {
+public:
+    unique_ptr<IBook> UnpackBook(const string& book_name) override {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        return BooksUnpacker::UnpackBook(book_name);
+    }
+};
+
 struct Library {
     vector<string> book_names;
     unordered_map<string, unique_ptr<IBook>> content;
@@ -122,6 +136,30 @@ void TestSmallCache(const Library& lib) {
     ASSERT_EQUAL(unpacker->GetMemoryUsedByBooks(), size_t(0))
 }
 
+// The least recently used book is evicted, even if it was unpacked later, than the used one
+void TestEvictionOrder(const Library&) {
+    auto unpacker = make_shared<BooksUnpacker>();
+    const vector<string> names = {"Book 1", "Book 2", "Book 3", "Book 4"};
+    ICache::Settings settings;
+    settings.max_memory = unpacker->UnpackBook(names[0])->GetContent().size() * 3;
+    auto cache = MakeCache(unpacker, settings);
+
+    cache->GetBook(names[0]);
+    cache->GetBook(names[1]);
+    cache->GetBook(names[2]);
+    cache->GetBook(names[0]);
+    cache->GetBook(names[3]);
+    ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), 5)
+
+    cache->GetBook(names[0]);
+    cache->GetBook(names[2]);
+    cache->GetBook(names[3]);
+    ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), 5)
+
+    cache->GetBook(names[1]);
+    ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), 6)
+}
+
 void TestAsync(const Library& lib) {
     static const int tasks_count = 10;
     static const int trials_count = 10000;
@@ -156,7 +194,257 @@ void TestAsync(const Library& lib) {
     }
 }
 
-int main() {
+// Memory of shards sums to max_memory, and it's never exceeded, when there are more shards, than books fit
+void TestShardedMaxMemory(const Library& lib) {
+    auto unpacker = make_shared<BooksUnpacker>();
+    ICache::Settings settings;
+    settings.max_memory = lib.size_in_bytes / 2;
+    settings.number_of_shards = 16;
+    auto cache = MakeCache(unpacker, settings);
+
+    for (int round = 0; round < 3; round++)
+        for (const auto& name : lib.book_names) {
+            ASSERT_EQUAL(cache->GetBook(name)->GetName(), name)
+            ASSERT(unpacker->GetMemoryUsedByBooks() <= settings.max_memory)
+        }
+}
+// Book, which is much bigger, than the others, is cached together with them, when memory is big enough to be sharded
+void TestBigBookCaching(const Library& lib) {
+    auto unpacker = make_shared<BooksUnpacker>();
+    ICache::Settings settings;
+    settings.max_memory = 64 << 20;
+    auto cache = MakeCache(unpacker, settings);
+
+    const string book_name(2 << 20, 'x');
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_EQUAL(cache->GetBook(book_name)->GetName(), book_name)
+        for (const auto& name : lib.book_names) {
+            ASSERT_EQUAL(cache->GetBook(name)->GetName(), name)
+        }
+    }
+    ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), static_cast<int>(lib.book_names.size() + 1))
+    ASSERT(unpacker->GetMemoryUsedByBooks() <= settings.max_memory)
+}
+// Threads, which miss the same book at once, wait for one unpacking of it and get the same book
+void TestSingleFlight(const Library& lib) {
+    static const int tasks_count = 8;
+
+    auto unpacker = make_shared<SlowBooksUnpacker>();
+    ICache::Settings settings;
+    settings.max_memory = lib.size_in_bytes;
+    auto cache = MakeCache(unpacker, settings);
+
+    vector<future<ICache::BookPtr>> tasks;
+    for (int task_num = 0; task_num < tasks_count; ++task_num) {
+        tasks.push_back(async(launch::async, [&cache, &lib] {
+            return cache->GetBook(lib.book_names[0]);
+        }));
+    }
+    const auto book = tasks[0].get();
+    for (int task_num = 1; task_num < tasks_count; ++task_num) {
+        ASSERT(tasks[task_num].get() == book)
+    }
+
+    ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), 1)
+    const auto statistics = cache->GetStatistics();
+    ASSERT_EQUAL(statistics.unpacks, size_t(1))
+    ASSERT_EQUAL(statistics.hits + statistics.saved_unpacks, size_t(tasks_count - 1))
+}
+const vector<ICache::EvictionPolicy> ALL_POLICIES = {
+        ICache::EvictionPolicy::Lru,
+        ICache::EvictionPolicy::TwoQueues,
+        ICache::EvictionPolicy::Arc,
+        ICache::EvictionPolicy::WTinyLfu
+};
+// Every policy keeps books in max_memory, returns right books and keeps all books, if they fit
+void TestPolicies(const Library& lib) {
+    for (const auto policy : ALL_POLICIES) {
+        auto unpacker = make_shared<BooksUnpacker>();
+        ICache::Settings settings;
+        settings.max_memory = lib.size_in_bytes / 2;
+        settings.eviction_policy = policy;
+        auto cache = MakeCache(unpacker, settings);
+
+        default_random_engine gen;
+        uniform_int_distribution<size_t> dis(0, lib.book_names.size() - 1);
+        for (int i = 0; i < 1000; ++i) {
+            const auto& book_name = lib.book_names[dis(gen)];
+            ASSERT_EQUAL(cache->GetBook(book_name)->GetName(), book_name)
+            ASSERT(unpacker->GetMemoryUsedByBooks() <= settings.max_memory)
+        }
+    }
+
+    for (const auto policy : ALL_POLICIES) {
+        auto unpacker = make_shared<BooksUnpacker>();
+        ICache::Settings settings;
+        settings.max_memory = lib.size_in_bytes;
+        settings.eviction_policy = policy;
+        auto cache = MakeCache(unpacker, settings);
+
+        for (int round = 0; round < 3; ++round) {
+            for (const auto& book_name : lib.book_names) {
+                cache->GetBook(book_name);
+            }
+        }
+        ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), static_cast<int>(lib.book_names.size()))
+    }
+}
+// Books, read several times, stay in cache after scan of books, which are read once, with any policy, except LRU
+void TestScanResistance(const Library&) {
+    for (const auto policy : ALL_POLICIES) {
+        auto unpacker = make_shared<BooksUnpacker>();
+        ICache::Settings settings;
+        settings.max_memory = unpacker->UnpackBook("Hot book 0")->GetContent().size() * 10;
+        settings.eviction_policy = policy;
+        auto cache = MakeCache(unpacker, settings);
+
+        int scanned_books_count = 0;
+        auto read_once = [&cache, &scanned_books_count] {
+            stringstream name;
+            name << "Once " << setw(5) << setfill('0') << scanned_books_count++;
+            cache->GetBook(name.str());
+        };
+        for (int round = 0; round < 5; ++round) {
+            for (int book = 0; book < 5; ++book) {
+                cache->GetBook("Hot book " + to_string(book));
+                read_once();
+            }
+        }
+        for (int book = 0; book < 100; ++book) {
+            read_once();
+        }
+
+        const int unpacked_books_count = unpacker->GetUnpackedBooksCount();
+        for (int book = 0; book < 5; ++book) {
+            cache->GetBook("Hot book " + to_string(book));
+        }
+        const int expected_count = policy == ICache::EvictionPolicy::Lru ? 5 : 0;
+        ASSERT_EQUAL(unpacker->GetUnpackedBooksCount() - unpacked_books_count, expected_count)
+    }
+}
+
+// Books, got by background workers, are the same, as read directly, and every one of them is unpacked once
+void TestGetBookAsync(const Library& lib) {
+    auto unpacker = make_shared<BooksUnpacker>();
+    ICache::Settings settings;
+    settings.max_memory = lib.size_in_bytes;
+    auto cache = MakeCache(unpacker, settings);
+
+    vector<future<ICache::BookPtr>> books;
+    for (int round = 0; round < 2; ++round) {
+        for (const auto& book_name : lib.book_names) {
+            books.push_back(cache->GetBookAsync(book_name));
+        }
+    }
+    for (size_t book = 0; book < books.size(); ++book) {
+        const auto& book_name = lib.book_names[book % lib.book_names.size()];
+        ASSERT_EQUAL(books[book].get()->GetContent(), lib.content.find(book_name)->second->GetContent())
+    }
+    ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), static_cast<int>(lib.book_names.size()))
+}
+// Prefetched books are read without unpacking, and prefetch of all books takes at most half of memory
+void TestPrefetch(const Library& lib) {
+    {
+        auto unpacker = make_shared<SlowBooksUnpacker>();
+        ICache::Settings settings;
+        settings.max_memory = lib.size_in_bytes;
+        auto cache = MakeCache(unpacker, settings);
+
+        const vector<string> next_books(lib.book_names.begin(), lib.book_names.begin() + 3);
+        cache->Prefetch(next_books).get();
+        ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), 3)
+        for (const auto& book_name : next_books) {
+            ASSERT_EQUAL(cache->GetBook(book_name)->GetName(), book_name)
+        }
+        ASSERT_EQUAL(unpacker->GetUnpackedBooksCount(), 3)
+        ASSERT_EQUAL(cache->GetStatistics().hits, size_t(3))
+    }
+
+    auto unpacker = make_shared<BooksUnpacker>();
+    ICache::Settings settings;
+    settings.max_memory = lib.size_in_bytes / 2;
+    auto cache = MakeCache(unpacker, settings);
+
+    cache->Prefetch(lib.book_names).get();
+    ASSERT(unpacker->GetMemoryUsedByBooks() <= settings.max_memory)
+    ASSERT(unpacker->GetUnpackedBooksCount() < static_cast<int>(lib.book_names.size()))
+}
+// Extension of asynchronous test - throughput of cache with one shard and with many of them, while number of
+// reading threads grows. Library is bigger, so threads mostly read different books, and half of it fits cache
+void BenchmarkAsync() {
+    static const int books_count = 10000;
+    static const int lookups_count = 640000;
+
+    BooksUnpacker unpacker;
+    vector<string> book_names;
+    for (int book = 0; book < books_count; ++book) {
+        book_names.push_back("Book #" + to_string(book));
+    }
+    const Library lib(move(book_names), unpacker);
+
+    for (const size_t shards_count : {1, 64}) {
+        for (int tasks_count = 1; tasks_count <= 64; tasks_count *= 2) {
+            ICache::Settings settings;
+            settings.max_memory = lib.size_in_bytes / 2;
+            settings.number_of_shards = shards_count;
+            auto cache = MakeCache(make_shared<BooksUnpacker>(), settings);
+
+            const auto start = chrono::steady_clock::now();
+            vector<future<void>> tasks;
+            for (int task_num = 0; task_num < tasks_count; ++task_num) {
+                tasks.push_back(async(launch::async, [&cache, &lib, task_num, tasks_count] {
+                    default_random_engine gen(task_num);
+                    uniform_int_distribution<size_t> dis(0, lib.book_names.size() - 1);
+                    for (int i = 0; i < lookups_count / tasks_count; ++i) {
+                        cache->GetBook(lib.book_names[dis(gen)]);
+                    }
+                }));
+            }
+            for (auto &task : tasks) {
+                task.get();
+            }
+            const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+            stringstream ss;
+            ss << "Shards: " << shards_count << ", threads: " << tasks_count << ", "
+               << static_cast<size_t>(lookups_count / elapsed.count()) << " lookups/s, "
+               << cache->GetStatistics().saved_unpacks << " saved unpacks\n";
+            cout << ss.str();
+        }
+    }
+}
+
+// Reader opens books of library one by one and reads every one of them for a while. With prefetch of the next books
+// it waits for unpacking only at the start of session
+void BenchmarkReadingSession(const Library& lib) {
+    static const int prefetched_books_count = 2;
+
+    for (const bool with_prefetch : {false, true}) {
+        ICache::Settings settings;
+        settings.max_memory = lib.size_in_bytes;
+        auto cache = MakeCache(make_shared<SlowBooksUnpacker>(), settings);
+
+        chrono::duration<double> stalled{};
+        for (size_t book = 0; book < lib.book_names.size(); ++book) {
+            if (with_prefetch) {
+                const size_t last = min(lib.book_names.size(), book + 1 + prefetched_books_count);
+                cache->Prefetch({lib.book_names.begin() + book + 1, lib.book_names.begin() + last});
+            }
+            const auto start = chrono::steady_clock::now();
+            cache->GetBook(lib.book_names[book]);
+            stalled += chrono::steady_clock::now() - start;
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+
+        stringstream ss;
+        ss << "Reading session " << (with_prefetch ? "with" : "without") << " prefetch: "
+           << static_cast<int>(stalled.count() * 1000) << " ms of waiting for books\n";
+        cout << ss.str();
+    }
+}
+
+// Benchmarks take much longer, than tests, so they're run only with --benchmark
+int main(int argc, char* argv[]) {
     BooksUnpacker unpacker;
     const Library lib({
                     "Sherlock Holmes",
@@ -180,8 +468,22 @@ int main() {
     RUN_CACHE_TEST(tr, TestMaxMemory);
     RUN_CACHE_TEST(tr, TestCaching);
     RUN_CACHE_TEST(tr, TestSmallCache);
+    RUN_CACHE_TEST(tr, TestEvictionOrder);
+    RUN_CACHE_TEST(tr, TestShardedMaxMemory);
+    RUN_CACHE_TEST(tr, TestBigBookCaching);
+    RUN_CACHE_TEST(tr, TestPolicies);
     RUN_CACHE_TEST(tr, TestAsync);
+    RUN_CACHE_TEST(tr, TestGetBookAsync);
+#ifdef CACHE_TEST_EXTENSIONS
+    RUN_CACHE_TEST(tr, TestPrefetch);
+    RUN_CACHE_TEST(tr, TestSingleFlight);
+    RUN_CACHE_TEST(tr, TestScanResistance);
+#endif
 
 #undef RUN_CACHE_TEST
+    if (argc > 1 && string(argv[1]) == "--benchmark") {
+        BenchmarkReadingSession(lib);
+        BenchmarkAsync();
+    }
     return 0;
 }
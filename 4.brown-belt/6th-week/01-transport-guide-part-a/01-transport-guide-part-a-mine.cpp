@@ -5,12 +5,34 @@
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string_view>
+#include <functional>
+#include <numeric>
+#include <limits>
+#include <future>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
-// Struct, needed to store description of route in map
+// Struct, needed to store description of route in database, stops are stored by their identifiers
 struct RouteDescription {
     bool linear{};
-    vector<string> stops;
+    vector<uint32_t> stops;
     int numberOfStops{};
     int numberOfUniqueStops{};
     double lengthOfRoute{};
@@ -22,168 +44,884 @@ struct Route {
     // Value
     RouteDescription routeDescription;
 };
+// Shortest way by buses between two stops, it's empty, if there is no such way
+struct Journey {
+    string from;
+    string to;
+    int numberOfStops{};
+    double length{};
+};
+// Commands and requests are parsed from one buffer with the whole input, and their names are views of it
+struct StopCommand {
+    string_view name;
+    double latitude{};
+    double longitude{};
+};
+// Route, as it's written in input, names are replaced by identifiers, when it's inserted to database
+struct RouteCommand {
+    string_view number;
+    bool linear{};
+    vector<string_view> stops;
+};
+// Request of second block, all of them are read before the first answer
+struct StatRequest {
+    string_view command;
+    // Number of bus or first stop of journey
+    string_view first;
+    // Second stop of journey
+    string_view second;
+};
+// Giving every name dense 32-bit identifier, so name is stored and hashed only once
+class NameRegistry {
+public:
+    NameRegistry() = default;
+    // Views of copy would point to names of original, while moved deque keeps it's elements in place
+    NameRegistry(const NameRegistry&) = delete;
+    NameRegistry& operator =(const NameRegistry&) = delete;
+    NameRegistry(NameRegistry&&) = default;
+    NameRegistry& operator =(NameRegistry&&) = default;
+
+    uint32_t Intern(string_view name) {
+        if (auto id = ids.find(name); id != end(ids))
+            return id->second;
+        // Deque never moves it's elements, so views of names stay valid
+        const auto id = static_cast<uint32_t>(names.size());
+        ids.emplace(names.emplace_back(name), id);
+        return id;
+    }
+
+    [[nodiscard]] optional<uint32_t> Find(string_view name) const {
+        if (auto id = ids.find(name); id != end(ids))
+            return id->second;
+        return nullopt;
+    }
+
+    [[nodiscard]] const string& GetName(uint32_t id) const {
+        return names[id];
+    }
+
+    [[nodiscard]] size_t Size() const {
+        return names.size();
+    }
+
+private:
+    deque<string> names;
+    unordered_map<string_view, uint32_t> ids;
+};
+// Binary snapshot of database is header and arrays after it in fixed order, every one aligned to 8 bytes. Arrays
+// are written as they're stored in memory, so they're read by copying, without parsing and trigonometry
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numberOfStops;
+    uint32_t numberOfRoutes;
+    uint32_t numberOfRouteStops;
+    uint32_t lengthOfStopNames;
+    uint32_t lengthOfRouteNames;
+    uint32_t numberOfEdges;
+    uint32_t withGraph;
+};
+// Route in snapshot, it's stops are routeStops[firstStop, lastStop)
+struct SnapshotRoute {
+    double lengthOfRoute;
+    uint32_t firstStop;
+    uint32_t lastStop;
+    int32_t numberOfStops;
+    int32_t numberOfUniqueStops;
+    uint32_t linear;
+    uint32_t reserved;
+};
+
+class SnapshotWriter {
+public:
+    template <typename T>
+    void WriteArray(const T* values, size_t size) {
+        static_assert(is_trivially_copyable_v<T>);
+        buffer.append(reinterpret_cast<const char*>(values), size * sizeof(T));
+        buffer.resize((buffer.size() + 7) / 8 * 8, '\0');
+    }
+
+    template <typename T>
+    void Write(const T& value) {
+        WriteArray(&value, 1);
+    }
+
+    [[nodiscard]] const string& GetBuffer() const {
+        return buffer;
+    }
+
+private:
+    string buffer;
+};
+// Reader checks, that every array is inside snapshot, so broken file gives exception instead of reading outside of it
+class SnapshotReader {
+public:
+    explicit SnapshotReader(string_view snapshot) : snapshot(snapshot) {}
+
+    template <typename T>
+    vector<T> ReadArray(size_t size) {
+        static_assert(is_trivially_copyable_v<T>);
+        // Size is read from snapshot too, so it's checked before anything is allocated for it
+        const char* data = take(size, sizeof(T));
+        vector<T> values(size);
+        if (size != 0)
+            memcpy(values.data(), data, size * sizeof(T));
+        return values;
+    }
+
+    template <typename T>
+    T Read() {
+        return ReadArray<T>(1).front();
+    }
+
+    string_view ReadText(size_t size) {
+        return {take(size, 1), size};
+    }
+
+    [[nodiscard]] bool IsFinished() const {
+        return position == snapshot.size();
+    }
+
+private:
+    string_view snapshot;
+    size_t position = 0;
+
+    const char* take(size_t size, size_t sizeOfElement) {
+        const size_t left = snapshot.size() - position;
+        if (size > left / sizeOfElement || (size * sizeOfElement + 7) / 8 * 8 > left)
+            throw runtime_error("Snapshot is truncated");
+
+        const char* data = snapshot.data() + position;
+        position += (size * sizeOfElement + 7) / 8 * 8;
+        return data;
+    }
+};
 // Main class
 class Database {
 private:
     // Used in task constants
     constexpr const static double PI = 3.1415926535;
     const static int RADIUS = 6371;
-    // Storing stop as identifier and pair of coordinates
-    unordered_map<string, pair<double, double>> storageOfStops;
-    // Storing route as identifier and structure with description
-    unordered_map<string, RouteDescription> storageOfRoutes;
-    // Method, calculating distance between provided stops
-    double calculateLength(const vector<string>& stops) {
-        double length = 0;
+    // Stop with coordinates in radians and their trigonometric functions, calculated once, when stop is inserted
+    struct StopPosition {
+        double latitude;
+        double longitude;
+        double sinOfLatitude;
+        double cosOfLatitude;
+    };
+    // Identifiers of stops and buses are positions of them in vectors
+    NameRegistry namesOfStops;
+    NameRegistry namesOfRoutes;
+    // Storing stop as coordinates, stop can be named in route before it's own command
+    vector<StopPosition> storageOfStops;
+    // Storing route as structure with description
+    vector<RouteDescription> storageOfRoutes;
+    // Distances between stops, shared by all routes and graph - sorted keys of segments, made of identifiers of both
+    // stops, smaller first, and distances of segments at the same positions
+    vector<uint64_t> keysOfSegments;
+    vector<double> distancesOfSegments;
+    // Graph of stops, where every two neighbouring stops of route are joined by edge, built once for all journeys
+    struct RouteGraph {
+        struct Edge {
+            uint32_t to;
+            double length;
+        };
+        // Edges from stop with identifier i are edges[offsets[i], offsets[i + 1])
+        vector<uint32_t> offsets;
+        vector<Edge> edges;
+        // Distances from every landmark to every stop and back, number i * NUMBER_OF_LANDMARKS + j is for stop i
+        // and landmark j, so all landmarks of stop are read together. By triangle inequality they give estimations
+        // of distance between any two stops
+        vector<double> fromLandmarks;
+        vector<double> toLandmarks;
+    };
+    constexpr const static size_t NUMBER_OF_LANDMARKS = 8;
+    constexpr const static double INFINITY_DISTANCE = numeric_limits<double>::infinity();
+    constexpr const static char SNAPSHOT_MAGIC[8] = {'T', 'G', 'S', 'N', 'A', 'P', '\0', '\0'};
+    constexpr const static uint32_t SNAPSHOT_VERSION = 1;
+    optional<RouteGraph> routeGraph;
+    // Buffers of one thread, reused by all searches, so search touches only stops, it reaches
+    struct SearchBuffers {
+        // Everything, search knows about one stop, is stored together to be read from memory at once
+        struct StopState {
+            double distance;
+            double estimation;
+            int numberOfStops;
+            // State of stop is known only, if it's set by current search, others are infinite distances
+            uint32_t search;
+        };
+        vector<StopState> states;
+        uint32_t currentSearch = 0;
+        // Heap of stops by distance from start plus estimation of distance to finish
+        vector<pair<double, uint32_t>> queue;
+    };
+
+    // Cosine of angle between close stops can be rounded to a bit more, than one, so it's limited to avoid NaN
+    static double calculateDistance(const StopPosition& first, const StopPosition& second) {
+        return acos(min(1.0, first.sinOfLatitude * second.sinOfLatitude +
+                             first.cosOfLatitude * second.cosOfLatitude *
+                             cos(abs(first.longitude - second.longitude)))) * RADIUS * 1000;
+    }
+    static uint64_t makeSegmentKey(uint32_t firstId, uint32_t secondId) {
+        return static_cast<uint64_t>(min(firstId, secondId)) << 32 | max(firstId, secondId);
+    }
+    // Distance of every segment of routes is calculated once, even if several routes go through it, segments are
+    // divided between several threads
+    void calculateSegmentDistances(size_t numberOfThreads) {
+        keysOfSegments.clear();
+        for (const auto& description : storageOfRoutes)
+            for (size_t position = 1; position < description.stops.size(); position++)
+                keysOfSegments.push_back(makeSegmentKey(description.stops[position - 1], description.stops[position]));
+        sort(begin(keysOfSegments), end(keysOfSegments));
+        keysOfSegments.erase(unique(begin(keysOfSegments), end(keysOfSegments)), end(keysOfSegments));
+
+        distancesOfSegments.resize(keysOfSegments.size());
+        const size_t segmentsPerThread = (keysOfSegments.size() + numberOfThreads - 1) / numberOfThreads;
+        vector<future<void>> parts;
+        for (size_t first = 0; first < keysOfSegments.size(); first += segmentsPerThread) {
+            const size_t last = min(first + segmentsPerThread, keysOfSegments.size());
+            parts.push_back(async(launch::async, [this, first, last] {
+                for (size_t segment = first; segment < last; segment++) {
+                    const uint64_t key = keysOfSegments[segment];
+                    distancesOfSegments[segment] = calculateDistance(storageOfStops[key >> 32],
+                                                                     storageOfStops[static_cast<uint32_t>(key)]);
+                }
+            }));
+        }
+        for (auto& part : parts)
+            part.get();
+    }
+    // Distance of segment of route, calculated before
+    double findDistance(uint32_t firstId, uint32_t secondId) const {
+        const auto key = lower_bound(begin(keysOfSegments), end(keysOfSegments), makeSegmentKey(firstId, secondId));
+        return distancesOfSegments[key - begin(keysOfSegments)];
+    }
+    // Distances from one stop to all others by Dijkstra's algorithm, unreachable stops are infinitely far
+    static vector<double> findAllDistances(const vector<uint32_t>& offsets, const vector<RouteGraph::Edge>& edges,
+                                           uint32_t from) {
+        vector<double> distances(offsets.size() - 1, INFINITY_DISTANCE);
+        vector<pair<double, uint32_t>> queue = {{0, from}};
+        distances[from] = 0;
+        while (!queue.empty()) {
+            pop_heap(begin(queue), end(queue), greater<>());
+            const auto [distance, stop] = queue.back();
+            queue.pop_back();
+            if (distance > distances[stop])
+                continue;
+
+            for (auto edge = offsets[stop]; edge < offsets[stop + 1]; edge++)
+                if (const auto& [next, length] = edges[edge]; distance + length < distances[next]) {
+                    distances[next] = distance + length;
+                    queue.emplace_back(distances[next], next);
+                    push_heap(begin(queue), end(queue), greater<>());
+                }
+        }
+
+        return distances;
+    }
+    // Edges go in both directions for linear routes, and only forward for circular ones
+    RouteGraph buildGraph() const {
+        vector<pair<uint32_t, uint32_t>> segments;
+        for (const auto& route : storageOfRoutes)
+            for (size_t position = 1; position < route.stops.size(); position++) {
+                const uint32_t previous = route.stops[position - 1], current = route.stops[position];
+                if (previous == current)
+                    continue;
+                segments.emplace_back(previous, current);
+                if (route.linear)
+                    segments.emplace_back(current, previous);
+            }
+        // The same segment of several routes is one edge
+        sort(begin(segments), end(segments));
+        segments.erase(unique(begin(segments), end(segments)), end(segments));
+
+        RouteGraph graph;
+        const size_t numberOfStops = storageOfStops.size();
+        graph.offsets.assign(numberOfStops + 1, 0);
+        graph.edges.reserve(segments.size());
+        for (const auto& [from, to] : segments) {
+            graph.offsets[from + 1]++;
+            graph.edges.push_back({to, findDistance(from, to)});
+        }
+        partial_sum(begin(graph.offsets), end(graph.offsets), begin(graph.offsets));
+        // Reversed graph is needed only to find distances to landmarks
+        vector<uint32_t> reversedOffsets(numberOfStops + 1, 0);
+        vector<RouteGraph::Edge> reversedEdges(graph.edges.size());
+        for (const auto& [to, length] : graph.edges)
+            reversedOffsets[to + 1]++;
+        partial_sum(begin(reversedOffsets), end(reversedOffsets), begin(reversedOffsets));
+        vector<uint32_t> filled(begin(reversedOffsets), prev(end(reversedOffsets)));
+        for (uint32_t from = 0; from < numberOfStops; from++)
+            for (auto edge = graph.offsets[from]; edge < graph.offsets[from + 1]; edge++)
+                reversedEdges[filled[graph.edges[edge].to]++] = {from, graph.edges[edge].length};
+        // Every next landmark is the stop, farthest from the chosen ones, so landmarks are spread over the city
+        vector<double> nearestLandmark(numberOfStops, INFINITY_DISTANCE);
+        graph.fromLandmarks.resize(numberOfStops * NUMBER_OF_LANDMARKS);
+        graph.toLandmarks.resize(numberOfStops * NUMBER_OF_LANDMARKS);
+        uint32_t landmark = 0;
+        for (size_t number = 0; number < NUMBER_OF_LANDMARKS && numberOfStops != 0; number++) {
+            const auto fromLandmark = findAllDistances(graph.offsets, graph.edges, landmark);
+            const auto toLandmark = findAllDistances(reversedOffsets, reversedEdges, landmark);
+            for (uint32_t stop = 0; stop < numberOfStops; stop++) {
+                graph.fromLandmarks[stop * NUMBER_OF_LANDMARKS + number] = fromLandmark[stop];
+                graph.toLandmarks[stop * NUMBER_OF_LANDMARKS + number] = toLandmark[stop];
+            }
+
+            double farthest = -1;
+            for (uint32_t stop = 0; stop < numberOfStops; stop++) {
+                nearestLandmark[stop] = min(nearestLandmark[stop], fromLandmark[stop]);
+                if (nearestLandmark[stop] != INFINITY_DISTANCE && nearestLandmark[stop] > farthest) {
+                    farthest = nearestLandmark[stop];
+                    landmark = stop;
+                }
+            }
+        }
+
+        return graph;
+    }
+    // Estimation of distance by route from stop to finish, which is never bigger, than the real one. It's the biggest
+    // of differences of distances to landmarks, or infinity, if landmarks show, there is no way. Straight distance
+    // costs more and it's taken only, when no landmark gives estimation
+    double estimateDistance(uint32_t stop, uint32_t finish) const {
+        const auto& graph = *routeGraph;
+        double estimation = 0;
+        for (size_t landmark = 0; landmark < NUMBER_OF_LANDMARKS && !graph.fromLandmarks.empty(); landmark++) {
+            // Landmark, which reaches stop, reaches finish through it
+            const double fromLandmarkToStop = graph.fromLandmarks[stop * NUMBER_OF_LANDMARKS + landmark];
+            const double fromLandmarkToFinish = graph.fromLandmarks[finish * NUMBER_OF_LANDMARKS + landmark];
+            if (fromLandmarkToStop != INFINITY_DISTANCE) {
+                if (fromLandmarkToFinish == INFINITY_DISTANCE)
+                    return INFINITY_DISTANCE;
+                estimation = max(estimation, fromLandmarkToFinish - fromLandmarkToStop);
+            }
+            // Stop reaches landmark through finish, which reaches it
+            const double fromStopToLandmark = graph.toLandmarks[stop * NUMBER_OF_LANDMARKS + landmark];
+            const double fromFinishToLandmark = graph.toLandmarks[finish * NUMBER_OF_LANDMARKS + landmark];
+            if (fromFinishToLandmark != INFINITY_DISTANCE) {
+                if (fromStopToLandmark == INFINITY_DISTANCE)
+                    return INFINITY_DISTANCE;
+                estimation = max(estimation, fromStopToLandmark - fromFinishToLandmark);
+            }
+        }
 
-        for (auto prevIt = begin(stops), it = next(begin(stops)); it != end(stops); prevIt++, it++) {
-            auto previousPair = storageOfStops.at(*prevIt);
-            auto currentPair = storageOfStops.at(*it);
+        return estimation > 0 ? estimation : calculateDistance(storageOfStops[stop], storageOfStops[finish]);
+    }
+    // A* search - stops are taken in order of distance from start plus estimation of distance to finish. Estimation
+    // is taken a bit smaller, so rounding can't make it bigger, than the real distance
+    optional<pair<double, int>> findShortestWay(uint32_t from, uint32_t to) const {
+        const double ESTIMATION_FACTOR = 0.999;
+        thread_local SearchBuffers buffers;
+        auto& [states, currentSearch, queue] = buffers;
+        if (states.size() < storageOfStops.size())
+            states.resize(storageOfStops.size(), {0, 0, 0, 0});
+        // When counter overflows, old marks could be taken for new ones, so they are cleaned
+        if (++currentSearch == 0) {
+            for (auto& state : states)
+                state.search = 0;
+            currentSearch = 1;
+        }
 
-            double lat_1 = previousPair.first * PI/180.0;
-            double long_1 = previousPair.second * PI/180.0;
-            double lat_2 = currentPair.first * PI/180.0;
-            double long_2 = currentPair.second * PI/180.0;
+        queue.clear();
+        states[from] = {0, estimateDistance(from, to) * ESTIMATION_FACTOR, 1, currentSearch};
+        if (states[from].estimation != INFINITY_DISTANCE)
+            queue.emplace_back(states[from].estimation, from);
+        while (!queue.empty()) {
+            pop_heap(begin(queue), end(queue), greater<>());
+            const auto [priority, stop] = queue.back();
+            queue.pop_back();
+            const auto current = states[stop];
+            if (stop == to)
+                return pair(current.distance, current.numberOfStops);
+            // Stop can be in queue several times, only the last one of them is actual
+            if (priority > current.distance + current.estimation)
+                continue;
 
-            length += acos(sin(lat_1) * sin(lat_2) +
-                           cos(lat_1) * cos(lat_2) *
-                           cos(abs(long_1 - long_2))) * RADIUS * 1000;
+            const auto& graph = *routeGraph;
+            for (auto edge = graph.offsets[stop]; edge < graph.offsets[stop + 1]; edge++) {
+                const auto& [next, length] = graph.edges[edge];
+                auto& state = states[next];
+                const double distance = current.distance + length;
+                if (state.search == currentSearch && state.distance <= distance)
+                    continue;
+                // Estimation is calculated once, when stop is reached first time, finish is never reached from
+                // stops with infinite one
+                if (state.search != currentSearch)
+                    state = {0, estimateDistance(next, to) * ESTIMATION_FACTOR, 0, currentSearch};
+
+                state.distance = distance;
+                state.numberOfStops = current.numberOfStops + 1;
+                if (state.estimation != INFINITY_DISTANCE) {
+                    queue.emplace_back(distance + state.estimation, next);
+                    push_heap(begin(queue), end(queue), greater<>());
+                }
+            }
         }
 
+        return nullopt;
+    }
+    // Names are written as offsets of their ends and all names together after them
+    static void writeNames(SnapshotWriter& writer, const NameRegistry& registry) {
+        vector<uint32_t> ends;
+        string text;
+        for (size_t id = 0; id < registry.Size(); id++) {
+            text += registry.GetName(id);
+            ends.push_back(text.size());
+        }
+        writer.WriteArray(ends.data(), ends.size());
+        writer.WriteArray(text.data(), text.size());
+    }
+    // Names are interned in order of their identifiers, so every name gets the same identifier, it had before
+    static void readNames(SnapshotReader& reader, NameRegistry& registry, size_t size, size_t length) {
+        const auto ends = reader.ReadArray<uint32_t>(size);
+        const auto text = reader.ReadText(length);
+        uint32_t begin = 0;
+        for (uint32_t id = 0; id < size; id++) {
+            if (ends[id] < begin || ends[id] > length || registry.Intern(text.substr(begin, ends[id] - begin)) != id)
+                throw runtime_error("Snapshot has broken names");
+            begin = ends[id];
+        }
+    }
+    // Method, calculating distance between provided stops by distances of segments, calculated before, so it's
+    // called by several threads at once
+    double calculateLength(const vector<uint32_t>& stops) const {
+        double length = 0;
+
+        for (auto prevIt = begin(stops), it = next(begin(stops)); it != end(stops); prevIt++, it++)
+            length += findDistance(*prevIt, *it);
+
         return length;
     }
-    // Because creating set and calculating length is expensive action, we do it only when needed
-    Route& initializeRoute(Route&& route) {
+    // Filling statistics of route by length of it's stops, which is calculated by caller
+    static void initializeDescription(RouteDescription& description, double lengthOfStops) {
         // Number of stops depends on type of route
-        if (route.routeDescription.linear)
-            route.routeDescription.numberOfStops = static_cast<int>(route.routeDescription.stops.size()) * 2 - 1;
+        if (description.linear)
+            description.numberOfStops = static_cast<int>(description.stops.size()) * 2 - 1;
         else
-            route.routeDescription.numberOfStops = route.routeDescription.stops.size();
-        // Initializing number of unique stops by set
-        route.routeDescription.numberOfUniqueStops = unordered_set(begin(route.routeDescription.stops),
-                                                                   end(route.routeDescription.stops)).size();
+            description.numberOfStops = description.stops.size();
+        // Initializing number of unique stops by set of identifiers
+        description.numberOfUniqueStops = unordered_set(begin(description.stops), end(description.stops)).size();
         // Calculating length of route
-        route.routeDescription.lengthOfRoute = calculateLength(route.routeDescription.stops)
-                                               * (1 + route.routeDescription.linear);
-
-        return route;
+        description.lengthOfRoute = lengthOfStops * (1 + description.linear);
     }
 
 public:
-    void InsertStop(pair<string, pair<double, double>>&& stop) {
-        const auto& [name, coordinates] = stop;
-        storageOfStops[name] = coordinates;
+    void InsertStop(const StopCommand& stop) {
+        const uint32_t id = namesOfStops.Intern(stop.name);
+        storageOfStops.resize(namesOfStops.Size());
+
+        const double latitude = stop.latitude * PI/180.0;
+        const double longitude = stop.longitude * PI/180.0;
+        storageOfStops[id] = {latitude, longitude, sin(latitude), cos(latitude)};
+        // Distances could be calculated for old place of stop
+        keysOfSegments.clear();
+        routeGraph.reset();
     }
 
-    void InsertRoute(Route&& route) {
-        const auto& [number, description] = route;
-        storageOfRoutes[number] = description;
+    void InsertRoute(const RouteCommand& route) {
+        RouteDescription description;
+        description.linear = route.linear;
+        description.stops.reserve(route.stops.size());
+        for (const auto& stop : route.stops)
+            description.stops.push_back(namesOfStops.Intern(stop));
+        storageOfStops.resize(namesOfStops.Size());
+
+        const uint32_t id = namesOfRoutes.Intern(route.number);
+        storageOfRoutes.resize(namesOfRoutes.Size());
+        storageOfRoutes[id] = move(description);
+        keysOfSegments.clear();
+        routeGraph.reset();
+    }
+    // After all stops and routes are inserted, distances of segments are calculated, every route is initialized by one
+    // of several threads, and graph is built, if journeys are needed. Then database is only read, so it's const
+    // methods can be called by any threads
+    void Freeze(size_t numberOfThreads, bool withJourneys) {
+        // Database, loaded from snapshot, or frozen before, already has everything, that needs distances
+        const bool withRoutes = any_of(begin(storageOfRoutes), end(storageOfRoutes), [](const auto& description) {
+            return description.numberOfStops == 0;
+        });
+        if (keysOfSegments.empty() && (withRoutes || (withJourneys && !routeGraph)))
+            calculateSegmentDistances(numberOfThreads);
+        const size_t routesPerThread = (storageOfRoutes.size() + numberOfThreads - 1) / numberOfThreads;
+        vector<future<void>> parts;
+        for (size_t first = 0; first < storageOfRoutes.size(); first += routesPerThread) {
+            const size_t last = min(first + routesPerThread, storageOfRoutes.size());
+            // Every thread changes only it's own routes
+            parts.push_back(async(launch::async, [this, first, last] {
+                for (size_t id = first; id < last; id++)
+                    if (auto& description = storageOfRoutes[id]; description.numberOfStops == 0)
+                        initializeDescription(description, calculateLength(description.stops));
+            }));
+        }
+        for (auto& part : parts)
+            part.get();
+
+        if (withJourneys && !routeGraph)
+            routeGraph = buildGraph();
+    }
+    // Snapshot of frozen database, it has graph, if database was frozen with journeys
+    string SaveSnapshot() const {
+        SnapshotHeader header{};
+        copy(begin(SNAPSHOT_MAGIC), end(SNAPSHOT_MAGIC), header.magic);
+        header.version = SNAPSHOT_VERSION;
+        header.numberOfStops = storageOfStops.size();
+        header.numberOfRoutes = storageOfRoutes.size();
+        vector<SnapshotRoute> routes;
+        vector<uint32_t> routeStops;
+        for (const auto& description : storageOfRoutes) {
+            routes.push_back({description.lengthOfRoute, static_cast<uint32_t>(routeStops.size()), 0,
+                              description.numberOfStops, description.numberOfUniqueStops, description.linear, 0});
+            routeStops.insert(end(routeStops), begin(description.stops), end(description.stops));
+            routes.back().lastStop = routeStops.size();
+        }
+        header.numberOfRouteStops = routeStops.size();
+        for (size_t id = 0; id < namesOfStops.Size(); id++)
+            header.lengthOfStopNames += namesOfStops.GetName(id).size();
+        for (size_t id = 0; id < namesOfRoutes.Size(); id++)
+            header.lengthOfRouteNames += namesOfRoutes.GetName(id).size();
+        header.withGraph = routeGraph.has_value();
+        header.numberOfEdges = routeGraph ? routeGraph->edges.size() : 0;
+
+        SnapshotWriter writer;
+        writer.Write(header);
+        writer.WriteArray(storageOfStops.data(), storageOfStops.size());
+        writeNames(writer, namesOfStops);
+        writeNames(writer, namesOfRoutes);
+        writer.WriteArray(routes.data(), routes.size());
+        writer.WriteArray(routeStops.data(), routeStops.size());
+        if (routeGraph) {
+            writer.WriteArray(routeGraph->offsets.data(), routeGraph->offsets.size());
+            writer.WriteArray(routeGraph->edges.data(), routeGraph->edges.size());
+            writer.WriteArray(routeGraph->fromLandmarks.data(), routeGraph->fromLandmarks.size());
+            writer.WriteArray(routeGraph->toLandmarks.data(), routeGraph->toLandmarks.size());
+        }
+        return writer.GetBuffer();
     }
-    // If route uninitialized, initialize it
-    Route getRoute(const string& number) {
-        if (storageOfRoutes.count(number)) {
-            Route result = {number, storageOfRoutes.at(number)};
-            result = (result.routeDescription.numberOfStops != 0) ? result : initializeRoute(move(result));
+    // Database, loaded from snapshot, is already frozen. Identifiers of stops are checked, so broken snapshot can't
+    // make database read outside of it's arrays
+    static Database LoadSnapshot(string_view snapshot) {
+        SnapshotReader reader(snapshot);
+        const auto header = reader.Read<SnapshotHeader>();
+        if (!equal(begin(SNAPSHOT_MAGIC), end(SNAPSHOT_MAGIC), header.magic) || header.version != SNAPSHOT_VERSION)
+            throw runtime_error("It's not a snapshot of transport database");
+
+        Database db;
+        db.storageOfStops = reader.ReadArray<StopPosition>(header.numberOfStops);
+        readNames(reader, db.namesOfStops, header.numberOfStops, header.lengthOfStopNames);
+        readNames(reader, db.namesOfRoutes, header.numberOfRoutes, header.lengthOfRouteNames);
+        const auto routes = reader.ReadArray<SnapshotRoute>(header.numberOfRoutes);
+        const auto routeStops = reader.ReadArray<uint32_t>(header.numberOfRouteStops);
+        const auto isStop = [&header](uint32_t stop) {
+            return stop < header.numberOfStops;
+        };
+        if (!all_of(begin(routeStops), end(routeStops), isStop))
+            throw runtime_error("Snapshot has broken routes");
+
+        db.storageOfRoutes.reserve(routes.size());
+        for (const auto& route : routes) {
+            if (route.firstStop > route.lastStop || route.lastStop > routeStops.size())
+                throw runtime_error("Snapshot has broken routes");
+            db.storageOfRoutes.push_back({route.linear != 0,
+                                          {begin(routeStops) + route.firstStop, begin(routeStops) + route.lastStop},
+                                          route.numberOfStops, route.numberOfUniqueStops, route.lengthOfRoute});
+        }
+
+        if (header.withGraph) {
+            RouteGraph graph;
+            graph.offsets = reader.ReadArray<uint32_t>(header.numberOfStops + size_t{1});
+            graph.edges = reader.ReadArray<RouteGraph::Edge>(header.numberOfEdges);
+            graph.fromLandmarks = reader.ReadArray<double>(header.numberOfStops * NUMBER_OF_LANDMARKS);
+            graph.toLandmarks = reader.ReadArray<double>(header.numberOfStops * NUMBER_OF_LANDMARKS);
+            if (graph.offsets.front() != 0 || graph.offsets.back() != graph.edges.size() ||
+                !is_sorted(begin(graph.offsets), end(graph.offsets)) ||
+                !all_of(begin(graph.edges), end(graph.edges), [&isStop](const auto& edge) {
+                    return isStop(edge.to);
+                }))
+                throw runtime_error("Snapshot has broken graph");
+            db.routeGraph = move(graph);
+        }
+
+        if (!reader.IsFinished())
+            throw runtime_error("Snapshot has extra data");
+        return db;
+    }
+    // Route of frozen database, which is already initialized
+    Route getRoute(string_view number) const {
+        if (const auto id = namesOfRoutes.Find(number))
+            return {string(number), storageOfRoutes[*id]};
+        return {string(number)};
+    }
+    // Journey in frozen database, which graph is already built
+    Journey getJourney(string_view from, string_view to) const {
+        Journey result = {string(from), string(to)};
+        const auto fromId = namesOfStops.Find(from);
+        const auto toId = namesOfStops.Find(to);
+        if (!fromId || !toId || !routeGraph)
             return result;
+
+        if (const auto way = findShortestWay(*fromId, *toId)) {
+            result.length = way->first;
+            result.numberOfStops = way->second;
         }
-        // If no route - return 'empty' route
-        return {number};
+        return result;
+    }
+};
+// Parser of the whole input, read to one buffer. It goes through buffer once, line by line, and names are taken
+// as views of it, so nothing is copied
+class InputParser {
+public:
+    explicit InputParser(string_view input) : input(input) {}
+
+    int ReadNumber() {
+        const auto line = trim(readLine());
+        int number = 0;
+        from_chars(line.data(), line.data() + line.size(), number);
+        return number;
+    }
+    // Command of the first block, which is stop or route, the other one is left unchanged
+    string_view ReadCommand(StopCommand& stop, RouteCommand& route) {
+        auto line = readLine();
+        const auto command = readToken(line, " ");
+
+        if (command == "Stop") {
+            stop.name = trim(readToken(line, ":"));
+            stop.latitude = readDouble(readToken(line, ","));
+            stop.longitude = readDouble(readToken(line, ","));
+        }
+
+        if (command == "Bus") {
+            route.number = trim(readToken(line, ":"));
+            // Circular route is written with '>' between stops and linear one with '-'
+            route.linear = line.find(" > ") == string_view::npos;
+            route.stops.clear();
+            while (!line.empty())
+                route.stops.push_back(trim(readToken(line, route.linear ? " - " : " > ")));
+        }
+
+        return command;
+    }
+
+    StatRequest ReadRequest() {
+        auto line = readLine();
+        StatRequest request;
+        request.command = readToken(line, " ");
+
+        if (request.command == "Bus")
+            request.first = trim(line);
+        // Journey between two stops, written as "Route first stop > second stop"
+        if (request.command == "Route") {
+            request.first = trim(readToken(line, " > "));
+            request.second = trim(line);
+        }
+
+        return request;
+    }
+
+private:
+    string_view input;
+
+    static string_view trim(string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+            text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+            text.remove_suffix(1);
+        return text;
+    }
+    // Cutting text before delimiter with the delimiter, or the whole text, if there is no delimiter
+    static string_view readToken(string_view& text, string_view delimiter) {
+        const size_t position = text.find(delimiter);
+        const auto token = text.substr(0, position);
+        text.remove_prefix(position == string_view::npos ? text.size() : position + delimiter.size());
+        return token;
+    }
+    // Coordinates are parsed by from_chars, which doesn't depend on locale and doesn't copy text
+    static double readDouble(string_view text) {
+        text = trim(text);
+        double number = 0;
+        from_chars(text.data(), text.data() + text.size(), number);
+        return number;
+    }
+    // Empty lines between commands are skipped
+    string_view readLine() {
+        string_view line;
+        while (trim(line).empty() && !input.empty())
+            line = readToken(input, "\n");
+        return line;
     }
 };
-// Simplifying input of stops
-istream& operator >>(istream& input, pair<string, pair<double, double>>& stop) {
-    string stopName, tmp;
-    input >> stopName;
-    // Inputting name
-    while (stopName.back() != ':') {
-        input >> tmp;
-        stopName.append(" " + tmp);
-    }
-    stopName.erase(stopName.size() - 1);
-    // Deleting trailing ':'
-    // Inputting coordinates
-    double x, y;
-    cin >> x;
-    cin.ignore(2);
-    cin >> y;
-
-    stop = {stopName, {x, y}};
-    return input;
-}
-// Simplifying input of routes
-istream& operator >>(istream& mainInput, Route& route) {
-    string number, tmp, stopName, line;
-    // Taking whole command
-    getline(mainInput, line);
-    // Taking number of bus (which is not only number) and erasing this part
-    route.number = line.substr(1, line.rfind(':') - 1);
-    line.erase(0, line.find(':') + 1);
-    // Remaining part sending to stream
-    stringstream input(line);
-    while (input) {
-        input >> tmp;
-        // Adding part of stop name, until sign of next stop is read
-        if (tmp != ">" && tmp != "-")
-            stopName.append(tmp + " ");
-        else {
-            // Then erasing trailing space, sending stop to vector and checking type of route
-            stopName.erase(stopName.size() - 1);
-            route.routeDescription.stops.push_back(move(stopName));
-            route.routeDescription.linear = tmp == "-";
-        }
-    }
-    // Repeating for last stop, because it's not ended by next stop sign
-    stopName.erase(stopName.size() - 2, 2);
-    stopName.erase(stopName.rfind(' '), tmp.size());
-    route.routeDescription.stops.push_back(move(stopName));
-
-    return mainInput;
-}
 // Simplifying output of route
 ostream& operator <<(ostream& output, const Route& route) {
-    cout << "Bus " << route.number << ": ";
+    output << "Bus " << route.number << ": ";
     // Checking if route is empty
     if (route.routeDescription.numberOfStops != 0)
-        cout << route.routeDescription.numberOfStops << " stops on route, "
-             << route.routeDescription.numberOfUniqueStops << " unique stops, "
-             << fixed << setprecision(6) << route.routeDescription.lengthOfRoute << " route length" << "\n";
+        output << route.routeDescription.numberOfStops << " stops on route, "
+               << route.routeDescription.numberOfUniqueStops << " unique stops, "
+               << fixed << setprecision(6) << route.routeDescription.lengthOfRoute << " route length" << "\n";
     else
-        cout << "not found" << "\n";
+        output << "not found" << "\n";
 
     return output;
 }
 
-int main() {
-    Database db;
-    int numberOfCommands;
-    string command;
-    // First block - input of data
-    cin >> numberOfCommands;
-    for (int i = 0; i < numberOfCommands; i++) {
-        cin >> command;
+// Simplifying output of journey
+ostream& operator <<(ostream& output, const Journey& journey) {
+    output << "Route " << journey.from << " > " << journey.to << ": ";
+    // Checking if journey is empty
+    if (journey.numberOfStops != 0)
+        output << journey.numberOfStops << " stops on route, "
+               << fixed << setprecision(6) << journey.length << " route length" << "\n";
+    else
+        output << "not found" << "\n";
 
-        if (command == "Stop") {
-            pair<string, pair<double, double>> stop;
-            cin >> stop;
-            db.InsertStop(move(stop));
+    return output;
+}
+
+// Reading the whole input to one buffer by big blocks
+string ReadInput(istream& input) {
+    string buffer;
+    char block[1 << 16];
+    while (input.read(block, sizeof(block)) || input.gcount() > 0)
+        buffer.append(block, input.gcount());
+    return buffer;
+}
+// File, mapped to memory only for reading
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+        const int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            throw runtime_error("Can't open " + path);
+
+        struct stat status{};
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            size = status.st_size;
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
         }
+        close(descriptor);
+        if (data == MAP_FAILED)
+            throw runtime_error("Can't map " + path);
+    }
 
-        if (command == "Bus") {
-            Route route;
-            cin >> route;
-            db.InsertRoute(move(route));
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator =(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        munmap(data, size);
+    }
+
+    [[nodiscard]] string_view GetData() const {
+        return {static_cast<const char*>(data), size};
+    }
+
+private:
+    void* data = MAP_FAILED;
+    size_t size = 0;
+};
+// Options of program, every one of them is optional
+struct Options {
+    // Speed of parsing, including insertion to database, is written to error stream
+    bool reportParsing = false;
+    // Database is frozen with graph and written to this file after the first block
+    string saveSnapshot;
+    // Database is loaded from this file, and input has only the second block
+    string loadSnapshot;
+};
+
+Options ParseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int argument = 1; argument < argc; argument++) {
+        const string_view text = argv[argument];
+        const size_t equalSign = text.find('=');
+        const auto name = text.substr(0, equalSign);
+        const auto value = equalSign == string_view::npos ? string_view() : text.substr(equalSign + 1);
+
+        if (name == "--report-parsing")
+            options.reportParsing = true;
+        else if (name == "--save-snapshot" && !value.empty())
+            options.saveSnapshot = value;
+        else if (name == "--load-snapshot" && !value.empty())
+            options.loadSnapshot = value;
+        else
+            throw invalid_argument("Unknown option " + string(text));
+    }
+
+    return options;
+}
+
+int main(int argc, char* argv[]) {
+    ios::sync_with_stdio(false);
+    Options options;
+    Database db;
+    try {
+        options = ParseOptions(argc, argv);
+        if (!options.loadSnapshot.empty()) {
+            const auto startOfLoading = chrono::steady_clock::now();
+            const MappedFile snapshot(options.loadSnapshot);
+            db = Database::LoadSnapshot(snapshot.GetData());
+            if (options.reportParsing) {
+                const chrono::duration<double> duration = chrono::steady_clock::now() - startOfLoading;
+                cerr << "Loaded snapshot of " << fixed << setprecision(2) << snapshot.GetData().size() / 1e6
+                     << " MB in " << duration.count() << " s" << "\n";
+            }
         }
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
     }
-    // Second block - output of data
-    cin >> numberOfCommands;
-    for (int i = 0; i < numberOfCommands; i++) {
-        cin >> command;
 
-        if (command == "Bus") {
-            string number;
-            getline(cin, number);
-            number = number.substr(number.find(' ') + 1, string::npos);
-            cout << db.getRoute(number);
+    const auto startOfParsing = chrono::steady_clock::now();
+    const string buffer = ReadInput(cin);
+    InputParser parser(buffer);
+    // First block - input of data, there is no such block after snapshot
+    StopCommand stop;
+    RouteCommand route;
+    for (int i = options.loadSnapshot.empty() ? parser.ReadNumber() : 0; i > 0; i--) {
+        const auto command = parser.ReadCommand(stop, route);
+
+        if (command == "Stop")
+            db.InsertStop(stop);
+
+        if (command == "Bus")
+            db.InsertRoute(route);
+    }
+    // Second block - all requests are read at first
+    vector<StatRequest> requests(max(0, parser.ReadNumber()));
+    bool withJourneys = false;
+    for (auto& request : requests) {
+        request = parser.ReadRequest();
+        withJourneys = withJourneys || request.command == "Route";
+    }
+    if (options.reportParsing) {
+        const chrono::duration<double> duration = chrono::steady_clock::now() - startOfParsing;
+        cerr << "Parsed and loaded " << fixed << setprecision(2) << buffer.size() / 1e6 << " MB in " << duration.count()
+             << " s, " << buffer.size() / 1e6 / max(duration.count(), 1e-9) << " MB/s" << "\n";
+    }
+    // Then they are answered by several threads, every thread writes answers to consecutive requests to it's own
+    // buffer, so buffers are printed in order of requests
+    const size_t numberOfThreads = max(1u, thread::hardware_concurrency());
+    if (!options.saveSnapshot.empty()) {
+        db.Freeze(numberOfThreads, true);
+        const string snapshot = db.SaveSnapshot();
+        if (!ofstream(options.saveSnapshot, ios::binary).write(snapshot.data(), snapshot.size())) {
+            cerr << "Can't write " << options.saveSnapshot << endl;
+            return 1;
         }
     }
+    db.Freeze(numberOfThreads, withJourneys);
+    const Database& frozenDb = db;
+    const size_t requestsPerThread = (requests.size() + numberOfThreads - 1) / numberOfThreads;
+    vector<future<string>> answers;
+    for (size_t first = 0; first < requests.size(); first += requestsPerThread)
+        answers.push_back(async(launch::async, [&frozenDb, &requests, first,
+                                                last = min(first + requestsPerThread, requests.size())] {
+            ostringstream output;
+            for (size_t i = first; i < last; i++) {
+                if (requests[i].command == "Bus")
+                    output << frozenDb.getRoute(requests[i].first);
+                if (requests[i].command == "Route")
+                    output << frozenDb.getJourney(requests[i].first, requests[i].second);
+            }
+            return output.str();
+        }));
+    for (auto& answer : answers)
+        cout << answer.get();
 }